@@ -0,0 +1,37 @@
+#include "Arena.hpp"
+
+namespace svg {
+
+Arena::Arena(size_t blockSize) : current_(0), used_(0), blockSize_(blockSize) {}
+
+Arena::~Arena() {
+    for (const Block &block : blocks_) ::operator delete(block.data);
+}
+
+void *Arena::allocate(size_t size, size_t align) {
+    while (current_ < blocks_.size()) {
+        // Align from the start of the block, which has the maximum alignment
+        size_t start = (used_ + align - 1) / align * align;
+        if (start + size <= blocks_[current_].size) {
+            used_ = start + size;
+            return blocks_[current_].data + start;
+        }
+
+        // Move to the next block, if it was kept by clear()
+        current_++;
+        used_ = 0;
+    }
+
+    // Objects larger than a block get a block of their own
+    size_t blockSize = size > blockSize_ ? size : blockSize_;
+    blocks_.push_back(Block{ (char *)::operator new(blockSize), blockSize });
+    current_ = blocks_.size() - 1;
+    used_    = size;
+    return blocks_[current_].data;
+}
+
+void Arena::clear() {
+    current_ = 0;
+    used_    = 0;
+}
+} // namespace svg
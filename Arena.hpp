@@ -0,0 +1,71 @@
+/// @file Arena.hpp
+#ifndef __svg_Arena_hpp__
+#define __svg_Arena_hpp__
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace svg {
+
+/// @brief  Bump allocator. Memory is taken from large blocks and is only given
+///         back all at once, so objects created in an arena are never destroyed
+///         one by one and must not own memory outside of it.
+class Arena {
+  private:
+    struct Block {
+        char  *data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks_;
+    size_t             current_; // Block being filled
+    size_t             used_;    // Bytes used in the current block
+    size_t             blockSize_;
+
+  public:
+    /// @param blockSize    Size of the blocks requested to the system
+    explicit Arena(size_t blockSize = 64 * 1024);
+    ~Arena();
+
+    Arena(const Arena &)            = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    /// @brief          Allocate memory
+    /// @param size     Number of bytes
+    /// @param align    Alignment
+    /// @return         Pointer to the memory, valid until the arena is cleared
+    void *allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+    /// @brief          Forget all allocations, keeping the blocks to reuse them
+    void clear();
+
+    /// @brief          Create an object in the arena
+    /// @param args     Constructor arguments
+    /// @return         Pointer to the new object
+    template <class T, class... Args>
+    T *create(Args &&...args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /// @brief          Copy an array of trivially copyable values into the arena
+    /// @param src      Values
+    /// @param n        Number of values
+    /// @return         Pointer to the copy
+    template <class T>
+    T *copy(const T *src, size_t n) {
+        T *dst = (T *)allocate(n * sizeof(T), alignof(T));
+        if (n) std::memcpy(dst, src, n * sizeof(T));
+        return dst;
+    }
+
+    /// @brief          Copy a string into the arena
+    /// @param str      String
+    /// @return         Pointer to the null terminated copy
+    const char *copy(const std::string &str) { return copy(str.c_str(), str.size() + 1); }
+};
+} // namespace svg
+#endif
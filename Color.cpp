@@ -1,10 +1,12 @@
 #include "Color.hpp"
-#include <iomanip>
-#include <map>
-#include <sstream>
+#include <cstring>
+#include <stdexcept>
 
 namespace svg {
-const std::map<std::string, Color> NAMES_TO_COLORS = {
+const struct {
+    const char *name;
+    Color       color;
+} NAMES_TO_COLORS[] = {
     { "black",       { 0, 0, 0 }},
     { "white", { 255, 255, 255 }},
     {   "red",     { 255, 0, 0 }},
@@ -13,17 +15,34 @@ const std::map<std::string, Color> NAMES_TO_COLORS = {
     {"yellow",   { 255, 255, 0 }}
 };
 
-Color parse_color(const std::string &str) {
+Color parse_color(const std::string &str) { return parse_color(str.c_str()); }
+
+Color parse_color(const char *str) {
+    if (str == nullptr || *str == '\0') throw std::out_of_range("parse_color: empty color");
     Color c;
-    if (str.at(0) == '#') {
-        int                v;
-        std::istringstream ss(str.substr(1));
-        ss >> std::hex >> v;
+    if (*str == '#') {
+        // Hexadecimal digits up to the first other character
+        unsigned v = 0;
+        for (const char *p = str + 1;; p++) {
+            int digit;
+            if (*p >= '0' && *p <= '9') {
+                digit = *p - '0';
+            } else if (*p >= 'a' && *p <= 'f') {
+                digit = *p - 'a' + 10;
+            } else if (*p >= 'A' && *p <= 'F') {
+                digit = *p - 'A' + 10;
+            } else {
+                break;
+            }
+            v = (v << 4) | digit;
+        }
         c.red   = (v >> 16);
         c.green = (v >> 8) & 0xFF;
         c.blue  = v & 0xFF;
     } else {
-        c = NAMES_TO_COLORS.at(str);
+        for (const auto &named : NAMES_TO_COLORS)
+            if (std::strcmp(named.name, str) == 0) return named.color;
+        throw std::out_of_range(std::string("parse_color: unknown color ") + str);
     }
     return c;
 }
@@ -25,5 +25,11 @@ struct Color {
 //! @return A corresponding color.
 Color parse_color(const std::string &str);
 
+//! Parse a color from a null terminated string, without
+//! allocating memory. Same formats as the std::string version.
+//! @param str String.
+//! @return A corresponding color.
+Color parse_color(const char *str);
+
 } // namespace svg
 #endif
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "DisplayList.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+// POSIX headers
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace svg {
+using namespace display_list;
+
+//* Writer
+
+DisplayListWriter::DisplayListWriter(std::vector<uint32_t> &words, int width, int height)
+    : words_(words), start_(words.size()), count_(0) {
+    words_.insert(words_.end(), { MAGIC, VERSION, (uint32_t)width, (uint32_t)height, 0, 0 });
+}
+
+void DisplayListWriter::command(Opcode op, size_t words, const Box &box, const Color &c) {
+    uint32_t color = c.red | c.green << 8 | c.blue << 16;
+    words_.insert(
+        words_.end(), { op, (uint32_t)words, (uint32_t)box.min.x, (uint32_t)box.min.y, (uint32_t)box.max.x,
+                        (uint32_t)box.max.y, color }
+    );
+    count_++;
+}
+
+void DisplayListWriter::ellipse(const Point &center, const Point &radius, const Color &fill) {
+    // Scaling may flip the radius
+    Point extent = { std::abs(radius.x), std::abs(radius.y) };
+    Box   box    = Box::empty().extend(center.translate({ -extent.x, -extent.y })).extend(center.translate(extent));
+    command(ELLIPSE, COMMAND_WORDS + 4, box, fill);
+    words_.insert(words_.end(), { (uint32_t)center.x, (uint32_t)center.y, (uint32_t)radius.x, (uint32_t)radius.y });
+}
+
+void DisplayListWriter::points(Opcode op, const PointView &points, const Color &c) {
+    Box box = Box::empty();
+    for (size_t i = 0; i < points.size(); i++) box = box.extend(points.at(i));
+    command(op, COMMAND_WORDS + 1 + 2 * points.size(), box, c);
+    words_.push_back((uint32_t)points.size());
+    words_.insert(words_.end(), points.x, points.x + points.size());
+    words_.insert(words_.end(), points.y, points.y + points.size());
+}
+
+void DisplayListWriter::polyline(const PointView &points, const Color &stroke) {
+    this->points(POLYLINE, points, stroke);
+}
+
+void DisplayListWriter::polygon(const PointView &points, const Color &fill) { this->points(POLYGON, points, fill); }
+
+void DisplayListWriter::finish() {
+    words_[start_ + 4] = count_;
+    words_[start_ + 5] = (uint32_t)(words_.size() - start_);
+}
+
+void compileDisplayList(const Document &document, std::vector<uint32_t> &words, TransformMode mode) {
+    compileDisplayList(document.elements(), document.dimensions(), words, mode);
+}
+
+void compileDisplayList(
+    const std::vector<SVGElement *> &elements, const Point &dimensions, std::vector<uint32_t> &words,
+    TransformMode mode
+) {
+    DisplayListWriter out(words, dimensions.x, dimensions.y);
+    TransformChain    root(mode);
+    for (const SVGElement *e : elements) e->compile(out, root);
+    out.finish();
+}
+
+//
+
+
+//* Reader
+
+DisplayList::DisplayList(const void *data, size_t bytes) : words_((const uint32_t *)data), size_(bytes / 4) {
+    if (bytes % 4 || size_ < HEADER_WORDS || words_[0] != MAGIC) {
+        throw std::runtime_error("Not a display list, or from a machine with another byte order");
+    }
+    if (words_[1] != VERSION) throw std::runtime_error("Unsupported display list version");
+    if (words_[5] != size_) throw std::runtime_error("Truncated display list");
+
+    // Check that the commands fit, so rendering needs no checks
+    size_t pos = HEADER_WORDS;
+    for (size_t i = 0; i < count(); i++) {
+        if (size_ - pos < COMMAND_WORDS || words_[pos + 1] > size_ - pos) {
+            throw std::runtime_error("Corrupt display list");
+        }
+        size_t words = words_[pos + 1];
+        bool   valid = false;
+        switch (words_[pos]) {
+        case ELLIPSE: valid = words == COMMAND_WORDS + 4; break;
+        case POLYLINE:
+        case POLYGON:
+            valid = words > COMMAND_WORDS && words == COMMAND_WORDS + 1 + 2 * (size_t)words_[pos + COMMAND_WORDS];
+            break;
+        default: break;
+        }
+        if (!valid) throw std::runtime_error("Corrupt display list");
+        pos += words;
+    }
+    if (pos != size_) throw std::runtime_error("Corrupt display list");
+}
+
+template <class Format> void DisplayList::render(BasicPNGImage<Format> &img) const {
+    const Box region = img.region();
+    for (size_t i = 0, pos = HEADER_WORDS; i < count(); i++, pos += words_[pos + 1]) {
+        const int32_t *cmd = (const int32_t *)(words_ + pos);
+        Box            box = { { cmd[2], cmd[3] }, { cmd[4], cmd[5] } };
+        if (!box.intersects(region)) continue; // Nothing to draw in the image
+
+        uint32_t       color = (uint32_t)cmd[6];
+        Color          c     = { (rgb_value)color, (rgb_value)(color >> 8), (rgb_value)(color >> 16) };
+        const int32_t *args  = cmd + COMMAND_WORDS;
+        switch (words_[pos]) {
+        case ELLIPSE: img.draw_ellipse({ args[0], args[1] }, { args[2], args[3] }, c); break;
+        case POLYLINE: {
+            size_t n = (size_t)args[0];
+            for (size_t j = 0; j + 1 < n; j++) {
+                img.draw_line({ args[1 + j], args[1 + n + j] }, { args[2 + j], args[2 + n + j] }, c);
+            }
+            break;
+        }
+        case POLYGON: {
+            size_t n = (size_t)args[0];
+            img.draw_polygon(PointView(args + 1, args + 1 + n, n), c);
+            break;
+        }
+        }
+    }
+}
+
+template void DisplayList::render(BasicPNGImage<RGB888> &) const;
+template void DisplayList::render(BasicPNGImage<RGBA8888> &) const;
+template void DisplayList::render(BasicPNGImage<Gray8> &) const;
+
+DisplayListFile::Mapping::Mapping(const std::string &file) : data(nullptr), bytes(0) {
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Unable to open " + file);
+    struct ::stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        bytes = (size_t)st.st_size;
+        data  = ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd); // The mapping stays valid
+    if (data == nullptr || data == MAP_FAILED) throw std::runtime_error("Unable to map " + file);
+}
+
+DisplayListFile::Mapping::~Mapping() { ::munmap(data, bytes); }
+
+DisplayListFile::DisplayListFile(const std::string &file) : map_(file), list_(map_.data, map_.bytes) {}
+} // namespace svg
@@ -0,0 +1,154 @@
+/// @file DisplayList.hpp
+#ifndef __svg_DisplayList_hpp__
+#define __svg_DisplayList_hpp__
+
+#include "Color.hpp"
+#include "PNGImage.hpp"
+#include "Point.hpp"
+#include "SVGElements.hpp"
+#include "Transform.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace svg {
+
+/// Binary display list: the drawing commands of a document with resolved geometry,
+/// in painter's order. It is an array of 32 bit words in the byte order of the
+/// machine that compiled it, so it can be rendered straight from a mapped file.
+///
+///     Header      magic, version, width, height, number of commands, number of words
+///     Command     opcode, number of words, bounding box (min x, min y, max x, max y),
+///                 color (red | green << 8 | blue << 16), then
+///                 ellipse:            center x, center y, radius x, radius y
+///                 polyline, polygon:  number of points n, n x coordinates, n y coordinates
+///
+/// Groups and uses are flattened: their elements are stored once per drawing.
+namespace display_list {
+const uint32_t MAGIC   = 0x4c445653; // "SVDL" in little endian
+const uint32_t VERSION = 1;
+
+const size_t HEADER_WORDS  = 6;
+const size_t COMMAND_WORDS = 7;
+
+/// @brief  Command opcodes
+enum Opcode : uint32_t { ELLIPSE = 1, POLYLINE = 2, POLYGON = 3 };
+} // namespace display_list
+
+/// @brief  Appends drawing commands to a display list
+class DisplayListWriter {
+  private:
+    std::vector<uint32_t> &words_;
+    size_t                 start_; // Position of the header in words_
+    uint32_t               count_; // Commands written
+
+    /// @brief          Append the start of a command
+    /// @param op       Opcode
+    /// @param words    Number of words of the command
+    /// @param box      Bounding box
+    /// @param c        Color
+    void command(display_list::Opcode op, size_t words, const Box &box, const Color &c);
+
+    /// @brief          Append a command with a sequence of points
+    void points(display_list::Opcode op, const PointView &points, const Color &c);
+
+  public:
+    /// @brief          Start a display list at the end of a buffer
+    /// @param words    Buffer
+    /// @param width    Image width
+    /// @param height   Image height
+    DisplayListWriter(std::vector<uint32_t> &words, int width, int height);
+
+    /// @brief          Append a filled ellipse
+    /// @param center   Center, in canvas coordinates
+    /// @param radius   Radius in X and Y
+    /// @param fill     Color
+    void ellipse(const Point &center, const Point &radius, const Color &fill);
+
+    /// @brief          Append a polyline
+    /// @param points   Points, in canvas coordinates
+    /// @param stroke   Color
+    void polyline(const PointView &points, const Color &stroke);
+
+    /// @brief          Append a filled polygon
+    /// @param points   Points, in canvas coordinates
+    /// @param fill     Color
+    void polygon(const PointView &points, const Color &fill);
+
+    /// @brief          Complete the header, no command may be added after it
+    void finish();
+};
+
+/// @brief              Compile a document into a display list, resolving its transformations
+/// @param document     Document
+/// @param words        Buffer where the display list is appended
+/// @param mode         How to apply the transformations
+void compileDisplayList(const Document &document, std::vector<uint32_t> &words, TransformMode mode);
+
+/// @brief              Compile some of the top level elements of a document, such as those
+///                     left by cullOccluded(), into a display list
+/// @param elements     Elements, in painter's order
+/// @param dimensions   Dimensions of the canvas
+/// @param words        Buffer where the display list is appended
+/// @param mode         How to apply the transformations
+void compileDisplayList(
+    const std::vector<SVGElement *> &elements, const Point &dimensions, std::vector<uint32_t> &words,
+    TransformMode mode
+);
+
+/// @brief  Read-only view of a display list in memory. Nothing is copied, the memory
+///         must outlive the view.
+class DisplayList {
+  private:
+    const uint32_t *words_;
+    size_t          size_; // In words
+
+  public:
+    /// @brief          View a display list, checking its header and commands
+    /// @param data     Display list, aligned to 4 bytes
+    /// @param bytes    Size of the display list in bytes
+    DisplayList(const void *data, size_t bytes);
+
+    /// @return Image width
+    int width() const { return (int)words_[2]; }
+
+    /// @return Image height
+    int height() const { return (int)words_[3]; }
+
+    /// @return Number of drawing commands
+    size_t count() const { return words_[4]; }
+
+    /// @brief          Draw the commands whose bounding box intersects the image region
+    /// @param img      Image to draw on, in any of the pixel formats of BasicPNGImage
+    template <class Format> void render(BasicPNGImage<Format> &img) const;
+};
+
+/// @brief  Display list file mapped in memory
+class DisplayListFile {
+  private:
+    /// @brief  Mapping of a whole file, read-only
+    struct Mapping {
+        void  *data;
+        size_t bytes;
+
+        /// @param file     File name
+        explicit Mapping(const std::string &file);
+        ~Mapping();
+    };
+
+    Mapping     map_;
+    DisplayList list_;
+
+  public:
+    /// @param file     Name of a display list file
+    explicit DisplayListFile(const std::string &file);
+
+    DisplayListFile(const DisplayListFile &)            = delete;
+    DisplayListFile &operator=(const DisplayListFile &) = delete;
+
+    /// @return Display list in the file
+    const DisplayList &list() const { return list_; }
+};
+} // namespace svg
+#endif
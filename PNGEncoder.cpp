@@ -0,0 +1,613 @@
+#include "PNGEncoder.hpp"
+#include "PNGImage.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+
+namespace svg {
+namespace {
+//! Deflate window size.
+const int WINDOW = 32768;
+//! Shortest and longest deflate matches.
+const int MIN_MATCH = 3, MAX_MATCH = 258;
+//! Symbols per deflate block.
+const size_t BLOCK_SYMBOLS = 32768;
+//! Longest code of the literal/length and distance alphabets, and of the code length alphabet.
+const int MAX_BITS = 15, MAX_CL_BITS = 7;
+
+//! First length of each length code (257 to 285) and its extra bits.
+const uint16_t LENGTH_BASE[29]  = { 3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t  LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                    2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+//! First distance of each distance code and its extra bits.
+const uint16_t DIST_BASE[30]    = { 1,    2,    3,    4,    5,    7,     9,     13,    17,    25,
+                                    33,   49,   65,   97,   129,  193,   257,   385,   513,   769,
+                                    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577 };
+const uint8_t  DIST_EXTRA[30]   = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+//! Order in which the code length code lengths are stored.
+const uint8_t  CL_ORDER[19]     = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+//! Longest chain searched and length good enough to stop, by level.
+const int MAX_CHAIN[10] = { 0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096 };
+const int NICE_LENGTH[10] = { 0, 8, 16, 32, 64, 128, 128, MAX_MATCH, MAX_MATCH, MAX_MATCH };
+
+//! Table of the CRC-32 used by PNG chunks.
+struct CRCTable {
+    uint32_t entries[256];
+    CRCTable() {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+};
+
+//! Update a CRC-32.
+//! @param crc CRC of the previous bytes (0 at the start).
+//! @param data Bytes.
+//! @param n Number of bytes.
+//! @return CRC including the bytes.
+uint32_t crc32(uint32_t crc, const unsigned char *data, size_t n) {
+    static const CRCTable table;
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+//! Adler-32 checksum of the zlib format.
+//! @param data Bytes.
+//! @param n Number of bytes.
+//! @return Checksum.
+uint32_t adler32(const unsigned char *data, size_t n) {
+    const uint32_t BASE = 65521;
+    uint32_t       a = 1, b = 0;
+    while (n > 0) {
+        size_t run = std::min<size_t>(n, 5552); // Longest run without overflow
+        for (size_t i = 0; i < run; i++) {
+            a += data[i];
+            b += a;
+        }
+        a    %= BASE;
+        b    %= BASE;
+        data += run;
+        n    -= run;
+    }
+    return b << 16 | a;
+}
+
+//! Adler-32 checksum of two runs of bytes joined, from the checksums of each run.
+//! @param adler1 Checksum of the first run.
+//! @param adler2 Checksum of the second run.
+//! @param n2 Length of the second run.
+//! @return Checksum of both runs.
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t n2) {
+    const uint64_t BASE = 65521;
+    uint64_t       rem  = n2 % BASE;
+    uint64_t       a    = ((adler1 & 0xFFFF) + (adler2 & 0xFFFF) + BASE - 1) % BASE;
+    uint64_t       b    = (rem * (adler1 & 0xFFFF) + (adler1 >> 16) + (adler2 >> 16) + BASE - rem) % BASE;
+    return (uint32_t)(b << 16 | a);
+}
+
+//! Append a 32 bit big endian value.
+void put_u32(std::vector<unsigned char> &out, uint32_t v) {
+    unsigned char bytes[4] = { (unsigned char)(v >> 24), (unsigned char)(v >> 16), (unsigned char)(v >> 8),
+                               (unsigned char)v };
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+//! Append a PNG chunk.
+//! @param out PNG file.
+//! @param type Chunk type.
+//! @param data Chunk data.
+//! @param n Size of the data.
+void put_chunk(std::vector<unsigned char> &out, const char *type, const unsigned char *data, size_t n) {
+    put_u32(out, (uint32_t)n);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + n);
+    put_u32(out, crc32(0, &out[start], out.size() - start));
+}
+
+//! Paeth predictor of the PNG format.
+inline int paeth(int a, int b, int c) {
+    int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) { return a; }
+    return pb <= pc ? b : c;
+}
+
+//! Filter a row.
+//! @param filter Filter, not Adaptive.
+//! @param row Row bytes.
+//! @param above Bytes of the row above (zeros for the first row).
+//! @param n Number of bytes.
+//! @param out Filter type followed by the filtered bytes.
+//! @tparam BPP Bytes per pixel.
+template <size_t BPP>
+void filter_row(PNGFilter filter, const unsigned char *row, const unsigned char *above, size_t n, unsigned char *out) {
+    out[0] = (unsigned char)filter;
+    out++;
+    switch (filter) {
+    case PNGFilter::None: ::memcpy(out, row, n); break;
+    case PNGFilter::Sub:
+        for (size_t i = 0; i < n; i++) out[i] = row[i] - (i >= BPP ? row[i - BPP] : 0);
+        break;
+    case PNGFilter::Up:
+        for (size_t i = 0; i < n; i++) out[i] = row[i] - above[i];
+        break;
+    case PNGFilter::Average:
+        for (size_t i = 0; i < n; i++) out[i] = row[i] - (((i >= BPP ? row[i - BPP] : 0) + above[i]) >> 1);
+        break;
+    default:
+        for (size_t i = 0; i < n; i++) {
+            out[i] = row[i] - paeth(i >= BPP ? row[i - BPP] : 0, above[i], i >= BPP ? above[i - BPP] : 0);
+        }
+        break;
+    }
+}
+
+//! Sum of the filtered bytes as signed values, the usual estimate of how well a row compresses.
+size_t filter_cost(const unsigned char *filtered, size_t n) {
+    size_t sum = 0;
+    for (size_t i = 0; i < n; i++) sum += std::abs((int)(signed char)filtered[i]);
+    return sum;
+}
+
+//! Writes bits in the order of the deflate format, least significant first.
+class BitWriter {
+  private:
+    std::vector<unsigned char> &out_;
+    uint64_t                    bits_;
+    int                         count_;
+
+  public:
+    explicit BitWriter(std::vector<unsigned char> &out) : out_(out), bits_(0), count_(0) {}
+
+    //! Append bits.
+    //! @param value Bits, least significant first.
+    //! @param n Number of bits (up to 32).
+    void put(uint32_t value, int n) {
+        bits_  |= (uint64_t)value << count_;
+        count_ += n;
+        while (count_ >= 8) {
+            out_.push_back((unsigned char)bits_);
+            bits_  >>= 8;
+            count_  -= 8;
+        }
+    }
+
+    //! Append bytes, once on a byte boundary.
+    //! @param data Bytes.
+    //! @param n Number of bytes.
+    void bytes(const unsigned char *data, size_t n) { out_.insert(out_.end(), data, data + n); }
+
+    //! Pad with zeros to a byte boundary.
+    void align() {
+        if (count_ > 0) { put(0, 8 - count_); }
+    }
+};
+
+//! Literal (dist 0) or match of the LZ77 pass.
+struct Symbol {
+    uint16_t litlen; // Literal byte, or match length
+    uint16_t dist;   // Match distance, 0 for literals
+};
+
+//! Length and distance codes of every match length and distance.
+struct CodeTables {
+    uint8_t length[MAX_MATCH + 1];
+    uint8_t dist[WINDOW + 1];
+    CodeTables() {
+        for (int code = 0; code < 29; code++) {
+            int to = code < 28 ? LENGTH_BASE[code + 1] : MAX_MATCH + 1;
+            for (int len = LENGTH_BASE[code]; len < to; len++) length[len] = (uint8_t)code;
+        }
+        for (int code = 0; code < 30; code++) {
+            int to = code < 29 ? DIST_BASE[code + 1] : WINDOW + 1;
+            for (int d = DIST_BASE[code]; d < to; d++) dist[d] = (uint8_t)code;
+        }
+    }
+};
+
+const CodeTables &code_tables() {
+    static const CodeTables tables;
+    return tables;
+}
+
+//! Code of a match length.
+inline int length_code(int length) { return code_tables().length[length]; }
+
+//! Code of a match distance.
+inline int dist_code(int dist) { return code_tables().dist[dist]; }
+
+//! Huffman code lengths for symbol frequencies, limited to a maximum length.
+//! Frequencies are halved until the lengths fit, which costs little compression.
+//! @param freq Frequencies.
+//! @param n Number of symbols.
+//! @param max_bits Longest code.
+//! @param lengths Filled with the code lengths (0 for unused symbols).
+void huffman_lengths(const uint32_t *freq, int n, int max_bits, uint8_t *lengths) {
+    std::vector<uint32_t> f(freq, freq + n);
+    for (;;) {
+        // Nodes 0 to n - 1 are leaves, the next ones are internal
+        std::vector<int> parent(2 * n, -1);
+        typedef std::pair<uint64_t, int> Item;
+        std::priority_queue<Item, std::vector<Item>, std::greater<Item>> heap;
+        for (int i = 0; i < n; i++) {
+            if (f[i]) heap.push(Item(f[i], i));
+        }
+        int next = n;
+        while (heap.size() > 1) {
+            Item a = heap.top();
+            heap.pop();
+            Item b = heap.top();
+            heap.pop();
+            parent[a.second] = parent[b.second] = next;
+            heap.push(Item(a.first + b.first, next++));
+        }
+        int longest = 0;
+        for (int i = 0; i < n; i++) {
+            int depth = 0;
+            if (f[i]) {
+                for (int node = i; parent[node] >= 0; node = parent[node]) depth++;
+            }
+            lengths[i] = (uint8_t)depth;
+            longest    = std::max(longest, depth);
+        }
+        if (longest <= max_bits) { return; }
+        for (uint32_t &v : f) {
+            if (v) { v = std::max<uint32_t>(1, v >> 1); }
+        }
+    }
+}
+
+//! Canonical Huffman codes for code lengths, bit reversed to be written least significant first.
+void huffman_codes(const uint8_t *lengths, int n, uint16_t *codes) {
+    int count[MAX_BITS + 1] = { 0 }, next[MAX_BITS + 2] = { 0 };
+    for (int i = 0; i < n; i++) count[lengths[i]]++;
+    count[0] = 0;
+    for (int bits = 1, code = 0; bits <= MAX_BITS; bits++) {
+        code       = (code + count[bits - 1]) << 1;
+        next[bits] = code;
+    }
+    for (int i = 0; i < n; i++) {
+        int len = lengths[i], code = len ? next[len]++ : 0, reversed = 0;
+        for (int b = 0; b < len; b++) reversed |= ((code >> b) & 1) << (len - 1 - b);
+        codes[i] = (uint16_t)reversed;
+    }
+}
+
+//! Deflates one band of the filtered image into a run of blocks ending on a byte boundary.
+class BandDeflater {
+  private:
+    const unsigned char *data_;   // Filtered image
+    size_t               begin_;  // Band start in data_
+    size_t               end_;    // Band end in data_
+    int                  level_;
+    std::vector<Symbol>  symbols_;
+    BitWriter            out_;
+
+    //! Hash of the 3 bytes at a position.
+    uint32_t hash(size_t pos) const {
+        return ((uint32_t)data_[pos] << 10 ^ (uint32_t)data_[pos + 1] << 5 ^ data_[pos + 2]) & (WINDOW - 1);
+    }
+
+    //! Find literals and matches with hash chains over the last WINDOW bytes.
+    //! The bytes of the previous bands before begin_ are in the window too.
+    void match() {
+        std::vector<int64_t> head(WINDOW, -1), prev(WINDOW, -1);
+        auto                 insert = [&](size_t pos) {
+            if (pos + MIN_MATCH > end_) { return; }
+            uint32_t h         = hash(pos);
+            prev[pos % WINDOW] = head[h];
+            head[h]            = (int64_t)pos;
+        };
+        for (size_t pos = begin_ > (size_t)WINDOW ? begin_ - WINDOW : 0; pos < begin_; pos++) insert(pos);
+
+        const int max_chain = MAX_CHAIN[level_], nice = NICE_LENGTH[level_];
+        auto      longest   = [&](size_t pos, int &dist) {
+            int     best   = MIN_MATCH - 1;
+            int     limit  = (int)std::min<size_t>(MAX_MATCH, end_ - pos);
+            int64_t lowest = (int64_t)pos - WINDOW;
+            int     chain  = max_chain;
+            if (limit < MIN_MATCH) { return 0; }
+            for (int64_t cur = head[hash(pos)]; cur >= 0 && cur > lowest && chain-- > 0; cur = prev[cur % WINDOW]) {
+                const unsigned char *a = data_ + cur, *b = data_ + pos;
+                if (a[best] != b[best] || a[0] != b[0]) { continue; }
+                int len = 0;
+                while (len < limit && a[len] == b[len]) len++;
+                if (len > best) {
+                    best = len;
+                    dist = (int)(pos - cur);
+                    if (len >= nice || len == limit) { break; }
+                }
+            }
+            return best >= MIN_MATCH ? best : 0;
+        };
+
+        for (size_t pos = begin_; pos < end_;) {
+            int dist = 0, len = longest(pos, dist);
+            insert(pos);
+            if (len && len < nice && level_ >= 4 && pos + 1 < end_) {
+                // Lazy matching: a longer match at the next byte turns this one into a literal
+                int next_dist = 0, next_len = longest(pos + 1, next_dist);
+                if (next_len > len) {
+                    symbols_.push_back({ data_[pos], 0 });
+                    insert(++pos);
+                    len  = next_len;
+                    dist = next_dist;
+                }
+            }
+            if (!len) {
+                symbols_.push_back({ data_[pos++], 0 });
+                continue;
+            }
+            symbols_.push_back({ (uint16_t)len, (uint16_t)dist });
+            for (int i = 1; i < len; i++) insert(pos + i);
+            pos += len;
+        }
+    }
+
+    //! Write the symbols of a block with fixed or dynamic codes, whichever is smaller.
+    void block(const Symbol *symbols, size_t n, bool final) {
+        uint32_t litlen_freq[288] = { 0 }, dist_freq[30] = { 0 };
+        for (size_t i = 0; i < n; i++) {
+            if (symbols[i].dist) {
+                litlen_freq[257 + length_code(symbols[i].litlen)]++;
+                dist_freq[dist_code(symbols[i].dist)]++;
+            } else {
+                litlen_freq[symbols[i].litlen]++;
+            }
+        }
+        litlen_freq[256] = 1;
+
+        // Complete codes need two symbols at least
+        if (std::count_if(litlen_freq, litlen_freq + 256, [](uint32_t f) { return f > 0; }) == 0) litlen_freq[0]++;
+        for (int i = 0; std::count_if(dist_freq, dist_freq + 30, [](uint32_t f) { return f > 0; }) < 2; i++) {
+            if (!dist_freq[i]) { dist_freq[i] = 1; }
+        }
+
+        uint8_t litlen_len[288], dist_len[30];
+        huffman_lengths(litlen_freq, 288, MAX_BITS, litlen_len);
+        huffman_lengths(dist_freq, 30, MAX_BITS, dist_len);
+        int hlit = 286, hdist = 30;
+        while (hlit > 257 && !litlen_len[hlit - 1]) hlit--;
+        while (hdist > 1 && !dist_len[hdist - 1]) hdist--;
+
+        // Code lengths of both alphabets, run length encoded with codes 16, 17 and 18
+        uint8_t lengths[286 + 30];
+        std::copy(litlen_len, litlen_len + hlit, lengths);
+        std::copy(dist_len, dist_len + hdist, lengths + hlit);
+        std::vector<std::pair<uint8_t, uint8_t>> runs; // Code and extra bits value
+        uint32_t                                 cl_freq[19] = { 0 };
+        for (int i = 0, total = hlit + hdist; i < total;) {
+            int run = 1;
+            while (i + run < total && lengths[i + run] == lengths[i]) run++;
+            if (lengths[i] == 0 && run >= 3) {
+                run = std::min(run, 138);
+                runs.push_back(run >= 11 ? std::make_pair(18, run - 11) : std::make_pair(17, run - 3));
+            } else if (i > 0 && lengths[i] == lengths[i - 1] && run >= 3) {
+                run = std::min(run, 6);
+                runs.push_back(std::make_pair(16, run - 3));
+            } else {
+                run = 1;
+                runs.push_back(std::make_pair(lengths[i], 0));
+            }
+            cl_freq[runs.back().first]++;
+            i += run;
+        }
+        if (std::count_if(cl_freq, cl_freq + 19, [](uint32_t f) { return f > 0; }) < 2) {
+            cl_freq[cl_freq[0] ? 1 : 0]++;
+        }
+        uint8_t cl_len[19];
+        huffman_lengths(cl_freq, 19, MAX_CL_BITS, cl_len);
+        int hclen = 19;
+        while (hclen > 4 && !cl_len[CL_ORDER[hclen - 1]]) hclen--;
+
+        // Sizes in bits with dynamic and fixed codes, leaving out what both share
+        uint64_t dynamic = 14 + 3 * hclen, fixed = 0;
+        for (int i = 0; i < 19; i++) {
+            int extra  = i == 16 ? 2 : i == 17 ? 3 : i == 18 ? 7 : 0;
+            dynamic   += (uint64_t)cl_freq[i] * (cl_len[i] + extra);
+        }
+        for (int i = 0; i < 286; i++) {
+            dynamic += (uint64_t)litlen_freq[i] * litlen_len[i];
+            fixed   += (uint64_t)litlen_freq[i] * (i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8);
+        }
+        for (int i = 0; i < 30; i++) {
+            dynamic += (uint64_t)dist_freq[i] * dist_len[i];
+            fixed   += (uint64_t)dist_freq[i] * 5;
+        }
+
+        // The fixed codes are defined over 288 literal/length symbols, two of them unused
+        uint16_t litlen_code[288], dist_code_bits[30];
+        if (fixed <= dynamic) {
+            for (int i = 0; i < 288; i++) litlen_len[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+            for (int i = 0; i < 30; i++) dist_len[i] = 5;
+            out_.put(final ? 1 : 0, 1);
+            out_.put(1, 2);
+        } else {
+            uint16_t cl_code[19];
+            huffman_codes(cl_len, 19, cl_code);
+            out_.put(final ? 1 : 0, 1);
+            out_.put(2, 2);
+            out_.put(hlit - 257, 5);
+            out_.put(hdist - 1, 5);
+            out_.put(hclen - 4, 4);
+            for (int i = 0; i < hclen; i++) out_.put(cl_len[CL_ORDER[i]], 3);
+            for (const auto &run : runs) {
+                out_.put(cl_code[run.first], cl_len[run.first]);
+                if (run.first == 16) { out_.put(run.second, 2); }
+                if (run.first == 17) { out_.put(run.second, 3); }
+                if (run.first == 18) { out_.put(run.second, 7); }
+            }
+        }
+        huffman_codes(litlen_len, 288, litlen_code);
+        huffman_codes(dist_len, 30, dist_code_bits);
+
+        for (size_t i = 0; i < n; i++) {
+            const Symbol &s = symbols[i];
+            if (!s.dist) {
+                out_.put(litlen_code[s.litlen], litlen_len[s.litlen]);
+                continue;
+            }
+            int lc = length_code(s.litlen), dc = dist_code(s.dist);
+            out_.put(litlen_code[257 + lc], litlen_len[257 + lc]);
+            out_.put(s.litlen - LENGTH_BASE[lc], LENGTH_EXTRA[lc]);
+            out_.put(dist_code_bits[dc], dist_len[dc]);
+            out_.put(s.dist - DIST_BASE[dc], DIST_EXTRA[dc]);
+        }
+        out_.put(litlen_code[256], litlen_len[256]);
+    }
+
+    //! Write the band as stored blocks.
+    void stored(bool final) {
+        for (size_t pos = begin_; pos < end_;) {
+            size_t n    = std::min<size_t>(65535, end_ - pos);
+            bool   last = pos + n == end_;
+            out_.put(final && last ? 1 : 0, 1);
+            out_.put(0, 2);
+            out_.align();
+            out_.put((uint32_t)n, 16);
+            out_.put((uint32_t)(~n & 0xFFFF), 16);
+            out_.bytes(data_ + pos, n);
+            pos += n;
+        }
+    }
+
+  public:
+    //! @param data Filtered image.
+    //! @param begin Band start in data.
+    //! @param end Band end in data.
+    //! @param level Compression level.
+    //! @param out Deflate data of the band.
+    BandDeflater(const unsigned char *data, size_t begin, size_t end, int level, std::vector<unsigned char> &out)
+        : data_(data), begin_(begin), end_(end), level_(level), out_(out) {}
+
+    //! Deflate the band.
+    //! @param final Whether the band is the last one, which ends the deflate stream.
+    void run(bool final) {
+        if (level_ == 0) {
+            stored(final);
+        } else {
+            match();
+            for (size_t i = 0; i < symbols_.size(); i += BLOCK_SYMBOLS) {
+                size_t n = std::min(BLOCK_SYMBOLS, symbols_.size() - i);
+                block(&symbols_[i], n, final && i + n == symbols_.size());
+            }
+        }
+        if (!final) {
+            // An empty stored block brings the next band to a byte boundary
+            out_.put(0, 3);
+            out_.align();
+            out_.put(0, 16);
+            out_.put(0xFFFF, 16);
+        }
+        out_.align();
+    }
+};
+} // namespace
+
+PNGFilter parse_png_filter(const std::string &name) {
+    static const char *const names[] = { "none", "sub", "up", "average", "paeth", "adaptive" };
+    for (int i = 0; i < 6; i++) {
+        if (name == names[i]) { return (PNGFilter)i; }
+    }
+    throw std::invalid_argument("Unknown PNG filter " + name);
+}
+
+template <class Format>
+void encode_png(const BasicPNGImage<Format> &img, const PNGOptions &options, std::vector<unsigned char> &out) {
+    const size_t BPP = Format::PNG_CHANNELS;
+    const int    w = img.width(), h = img.height();
+    const size_t row_bytes = (size_t)w * BPP, line = row_bytes + 1; // Filter type and row
+    const int    level     = std::max(0, std::min(9, options.level));
+    const int    band_rows = options.bandRows > 0 ? options.bandRows : std::max(1, (int)(256 * 1024 / line));
+    const size_t bands     = (h + band_rows - 1) / band_rows;
+    auto         first_row = [&](size_t band) { return (int)std::min<size_t>(h, band * band_rows); };
+
+    // Filter the bands in parallel. All of them are filtered before deflating,
+    // since each band looks back at the end of the previous one.
+    std::vector<unsigned char> filtered(line * h);
+    std::vector<unsigned char> zeros(row_bytes, 0);
+    parallelFor(bands, options.threads, [&](size_t band) {
+        // Rows converted to the PNG channels, if the format needs it, alternate between two buffers
+        std::vector<unsigned char> trial(line), buffers(2 * row_bytes);
+        const int                  first = first_row(band);
+        const unsigned char       *above = zeros.data();
+        if (first > 0) { above = Format::png_row(img.row(first - 1), w, &buffers[row_bytes * ((first - 1) & 1)]); }
+        for (int y = first; y < first_row(band + 1); y++) {
+            const unsigned char *row = Format::png_row(img.row(y), w, &buffers[row_bytes * (y & 1)]);
+            unsigned char       *dst = &filtered[line * y];
+            if (options.filter != PNGFilter::Adaptive) {
+                filter_row<BPP>(options.filter, row, above, row_bytes, dst);
+            } else {
+                size_t best = (size_t)-1;
+                for (int f = 0; f < 5; f++) {
+                    filter_row<BPP>((PNGFilter)f, row, above, row_bytes, trial.data());
+                    size_t cost = filter_cost(trial.data() + 1, row_bytes);
+                    if (cost < best) {
+                        best = cost;
+                        std::copy(trial.begin(), trial.end(), dst);
+                    }
+                }
+            }
+            above = row;
+        }
+    });
+
+    // Deflate each band into its own IDAT chunk, with the checksum of its data
+    std::vector<std::vector<unsigned char>> chunks(bands);
+    std::vector<uint32_t>                   adlers(bands);
+    parallelFor(bands, options.threads, [&](size_t band) {
+        size_t                      begin = line * first_row(band), end = line * first_row(band + 1);
+        std::vector<unsigned char> &chunk = chunks[band];
+        chunk.assign(4, 0); // Length, set below
+        chunk.insert(chunk.end(), { 'I', 'D', 'A', 'T' });
+        if (band == 0) {
+            // zlib header: deflate with a 32K window, and the class of the level
+            chunk.push_back(0x78);
+            chunk.push_back(level == 0 ? 0x01 : level < 6 ? 0x5E : level == 6 ? 0x9C : 0xDA);
+        }
+        BandDeflater(filtered.data(), begin, end, level, chunk).run(band + 1 == bands);
+        adlers[band]  = adler32(&filtered[begin], end - begin);
+        uint32_t size = (uint32_t)(chunk.size() - 8);
+        for (int i = 0; i < 4; i++) chunk[i] = (unsigned char)(size >> (24 - 8 * i));
+        put_u32(chunk, crc32(0, &chunk[4], chunk.size() - 4));
+    });
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    const unsigned char        color_type   = BPP == 1 ? 0 : 2; // 8 bit grey or RGB
+    unsigned char              header[13]   = { 0, 0, 0, 0, 0, 0, 0, 0, 8, color_type, 0, 0, 0 };
+    for (int i = 0; i < 4; i++) {
+        header[i]     = (unsigned char)(w >> (24 - 8 * i));
+        header[4 + i] = (unsigned char)(h >> (24 - 8 * i));
+    }
+    out.assign(signature, signature + 8);
+    put_chunk(out, "IHDR", header, sizeof(header));
+    uint32_t adler = 1; // Of no data
+    for (size_t band = 0; band < bands; band++) {
+        out.insert(out.end(), chunks[band].begin(), chunks[band].end());
+        adler = adler32_combine(adler, adlers[band], line * (first_row(band + 1) - first_row(band)));
+    }
+
+    // The zlib checksum ends the stream, in a last IDAT chunk
+    std::vector<unsigned char> trailer;
+    put_u32(trailer, adler);
+    put_chunk(out, "IDAT", trailer.data(), trailer.size());
+    put_chunk(out, "IEND", nullptr, 0);
+}
+
+template void encode_png(const BasicPNGImage<RGB888> &, const PNGOptions &, std::vector<unsigned char> &);
+template void encode_png(const BasicPNGImage<RGBA8888> &, const PNGOptions &, std::vector<unsigned char> &);
+template void encode_png(const BasicPNGImage<Gray8> &, const PNGOptions &, std::vector<unsigned char> &);
+
+} // namespace svg
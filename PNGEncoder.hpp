@@ -0,0 +1,60 @@
+//! @file PNGEncoder.hpp
+#ifndef __svg_PNGEncoder_hpp__
+#define __svg_PNGEncoder_hpp__
+
+#include <string>
+#include <vector>
+
+namespace svg {
+template <class Format> class BasicPNGImage;
+
+//! Row filters of the PNG format.
+enum class PNGFilter {
+    //! Raw bytes.
+    None,
+    //! Difference with the pixel on the left.
+    Sub,
+    //! Difference with the pixel above.
+    Up,
+    //! Difference with the average of the left and upper pixels.
+    Average,
+    //! Difference with the Paeth predictor of the left, upper and upper left pixels.
+    Paeth,
+    //! For each row, the filter giving the smallest sum of absolute differences.
+    Adaptive
+};
+
+//! Settings of the PNG encoder.
+struct PNGOptions {
+    //! Compression level, from 0 (stored, fastest) to 9 (smallest files).
+    int       level;
+    //! Row filter.
+    PNGFilter filter;
+    //! Threads encoding bands of rows in parallel (0 uses one per hardware thread).
+    unsigned  threads;
+    //! Rows per band (0 picks bands of about 256 KiB).
+    int       bandRows;
+
+    PNGOptions() : level(6), filter(PNGFilter::Adaptive), threads(0), bandRows(0) {}
+};
+
+//! Parse the name of a PNG filter.
+//! @param name "none", "sub", "up", "average", "paeth" or "adaptive".
+//! @return The filter.
+PNGFilter parse_png_filter(const std::string &name);
+
+//! Encode an image as a PNG file in memory.
+//! The image is split in bands of rows that are filtered and deflated in
+//! parallel; each band is a run of deflate blocks ending on a byte boundary
+//! that may refer back to the previous bands, and is stored in its own IDAT
+//! chunk, so the bands join into one zlib stream without being copied.
+//! Rows are converted to the PNG channels of the format as they are filtered.
+//! Instantiated for the pixel formats of BasicPNGImage.
+//! @param img Image.
+//! @param options Encoder settings.
+//! @param out Filled with the PNG file.
+template <class Format>
+void encode_png(const BasicPNGImage<Format> &img, const PNGOptions &options, std::vector<unsigned char> &out);
+
+} // namespace svg
+#endif
@@ -3,9 +3,15 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdio>
 #include <cstring>
 #include <stdexcept>
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SVG_X86_SIMD
+#include <immintrin.h>
+#endif
+
 #define STBI_ONLY_PNG
 #define STB_IMAGE_IMPLEMENTATION
 #include "external/stb/stb_image.h"
@@ -13,145 +19,425 @@
 #include "external/stb/stb_image_write.h"
 
 namespace svg {
-PNGImage::PNGImage(const std::string &png_file_name) {
+namespace {
+//! Write a run of pixels of the same color.
+//! @param dst First pixel.
+//! @param n Number of pixels.
+//! @param c Color.
+void fill_pixels_scalar(Color *dst, size_t n, const Color &c) {
+    for (size_t i = 0; i < n; i++) { dst[i] = c; }
+}
+
+#ifdef SVG_X86_SIMD
+//! Fill the 3 * N byte pattern of N pixels of the same color.
+//! @param pattern Pattern buffer.
+//! @param n Number of pixels.
+//! @param c Color.
+void fill_pattern(Color *pattern, size_t n, const Color &c) {
+    for (size_t i = 0; i < n; i++) { pattern[i] = c; }
+}
+
+//! SSE2 version of fill_pixels_scalar(), storing 16 pixels (3 registers)
+//! at a time.
+void fill_pixels_sse2(Color *dst, size_t n, const Color &c) {
+    Color pattern[16];
+    fill_pattern(pattern, 16, c);
+    const __m128i *p  = (const __m128i *)pattern;
+    __m128i        p0 = _mm_loadu_si128(p), p1 = _mm_loadu_si128(p + 1),
+            p2 = _mm_loadu_si128(p + 2);
+    for (; n >= 16; n -= 16, dst += 16) {
+        __m128i *d = (__m128i *)dst;
+        _mm_storeu_si128(d, p0);
+        _mm_storeu_si128(d + 1, p1);
+        _mm_storeu_si128(d + 2, p2);
+    }
+    fill_pixels_scalar(dst, n, c);
+}
+
+//! AVX2 version of fill_pixels_scalar(), storing 32 pixels (3 registers)
+//! at a time.
+__attribute__((target("avx2"))) void
+fill_pixels_avx2(Color *dst, size_t n, const Color &c) {
+    Color pattern[32];
+    fill_pattern(pattern, 32, c);
+    const __m256i *p  = (const __m256i *)pattern;
+    __m256i        p0 = _mm256_loadu_si256(p), p1 = _mm256_loadu_si256(p + 1),
+            p2 = _mm256_loadu_si256(p + 2);
+    for (; n >= 32; n -= 32, dst += 32) {
+        __m256i *d = (__m256i *)dst;
+        _mm256_storeu_si256(d, p0);
+        _mm256_storeu_si256(d + 1, p1);
+        _mm256_storeu_si256(d + 2, p2);
+    }
+    fill_pixels_scalar(dst, n, c);
+}
+#endif
+
+//! Pick the widest fill_pixels version the CPU supports.
+//! @return Fill function.
+void (*select_fill_pixels())(Color *, size_t, const Color &) {
+#ifdef SVG_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) { return fill_pixels_avx2; }
+    return fill_pixels_sse2;
+#else
+    return fill_pixels_scalar;
+#endif
+}
+
+//! Write a run of pixels of the same color, using SIMD stores if available.
+//! Short runs do not pay for building the SIMD pattern.
+//! @param dst First pixel.
+//! @param n Number of pixels.
+//! @param c Color.
+void fill_pixels(Color *dst, size_t n, const Color &c) {
+    static void (*const fill)(Color *, size_t, const Color &)
+        = select_fill_pixels();
+    if (n < 32) {
+        fill_pixels_scalar(dst, n, c);
+    } else {
+        fill(dst, n, c);
+    }
+}
+
+//! Write a run of 4 byte pixels of the same color. Pixels are aligned to
+//! 4 bytes, so after at most 3 of them the stores are aligned to 16 bytes.
+//! @param dst First pixel.
+//! @param n Number of pixels.
+//! @param p Pixel.
+void fill_pixels(RGBA8888::Pixel *dst, size_t n, const RGBA8888::Pixel &p) {
+#ifdef SVG_X86_SIMD
+    for (; n > 0 && ((uintptr_t)dst & 15) != 0; n--) { *dst++ = p; }
+    uint32_t value;
+    ::memcpy(&value, &p, sizeof(value));
+    const __m128i pattern = _mm_set1_epi32((int)value);
+    for (; n >= 4; n -= 4, dst += 4) { _mm_store_si128((__m128i *)dst, pattern); }
+#endif
+    for (size_t i = 0; i < n; i++) { dst[i] = p; }
+}
+
+//! Write a run of grey pixels of the same value.
+//! @param dst First pixel.
+//! @param n Number of pixels.
+//! @param p Pixel.
+void fill_pixels(Gray8::Pixel *dst, size_t n, const Gray8::Pixel &p) { ::memset(dst, p, n); }
+} // namespace
+
+PixelFormat parse_pixel_format(const std::string &name) {
+    if (name == "rgb") { return PixelFormat::RGB888; }
+    if (name == "rgba") { return PixelFormat::RGBA8888; }
+    if (name == "gray") { return PixelFormat::Gray8; }
+    throw std::invalid_argument("Unknown pixel format " + name);
+}
+
+template <class Format>
+BasicPNGImage<Format>::BasicPNGImage(const std::string &png_file_name) : left_(0), top_(0), counters_(nullptr) {
     int dummy;
-    pixels_ = (Color *)::stbi_load(
-        png_file_name.c_str(), &width_, &height_, &dummy, 3
+    pixels_ = (Pixel *)::stbi_load(
+        png_file_name.c_str(), &width_, &height_, &dummy, Format::CHANNELS
     );
     if (pixels_ == nullptr) {
         throw std::runtime_error(png_file_name + ": could not load image!");
     }
+    capacity_ = width_ * height_;
+}
+
+template <class Format>
+BasicPNGImage<Format>::BasicPNGImage(const unsigned char *png, size_t size) : left_(0), top_(0), counters_(nullptr) {
+    int dummy;
+    pixels_ = (Pixel *)::stbi_load_from_memory(png, (int)size, &width_, &height_, &dummy, Format::CHANNELS);
+    if (pixels_ == nullptr) { throw std::runtime_error("PNG in memory: could not load image!"); }
+    capacity_ = width_ * height_;
+}
+
+template <class Format> BasicPNGImage<Format>::BasicPNGImage(int w, int h) : BasicPNGImage(0, 0, w, h) {}
+
+template <class Format>
+BasicPNGImage<Format>::BasicPNGImage(int x, int y, int w, int h)
+    : left_(x), top_(y), capacity_(0), pixels_(nullptr), counters_(nullptr) {
+    reset(w, h);
 }
 
-PNGImage::PNGImage(int w, int h) {
+template <class Format> void BasicPNGImage<Format>::reset(int w, int h) {
     assert(w > 0 && h > 0);
-    size_t sz = w * h * sizeof(Color);
-    pixels_   = (Color *)::stbi__malloc(sz);
-    width_    = w;
-    height_   = h;
-    ::memset(pixels_, 0xFF, sz);
+    size_t n = w * h;
+    if (n > capacity_) {
+        stbi_image_free(pixels_);
+        pixels_   = (Pixel *)::stbi__malloc(n * sizeof(Pixel));
+        capacity_ = n;
+    }
+    width_  = w;
+    height_ = h;
+    ::memset(pixels_, 0xFF, n * sizeof(Pixel));
 }
 
-void PNGImage::save(const std::string &png_file_name) const {
-    ::stbi_write_png(
-        png_file_name.c_str(), width_, height_, 3, pixels_, width_ * 3
-    );
+template <class Format> void BasicPNGImage<Format>::save(const std::string &png_file_name) const {
+    // Formats whose pixels are not stored as in the file are converted first
+    const int                  stride = width_ * Format::PNG_CHANNELS;
+    const void                *data   = pixels_;
+    std::vector<unsigned char> converted;
+    if (Format::PNG_CHANNELS != Format::CHANNELS) {
+        converted.resize((size_t)stride * height_);
+        for (int y = 0; y < height_; y++) { Format::png_row(row(y), width_, &converted[(size_t)y * stride]); }
+        data = converted.data();
+    }
+    if (!::stbi_write_png(
+            png_file_name.c_str(), width_, height_, Format::PNG_CHANNELS, data, stride
+        )) {
+        throw std::runtime_error(png_file_name + ": could not save image!");
+    }
+}
+
+template <class Format>
+void BasicPNGImage<Format>::save(const std::string &png_file_name, const PNGOptions &options) const {
+    std::vector<unsigned char> png;
+    encode_png(*this, options, png);
+    FILE *file = ::fopen(png_file_name.c_str(), "wb");
+    bool  ok   = file && ::fwrite(png.data(), 1, png.size(), file) == png.size();
+    if (file && ::fclose(file) != 0) { ok = false; }
+    if (!ok) { throw std::runtime_error(png_file_name + ": could not save image!"); }
+}
+
+template <class Format> BasicPNGImage<Format>::~BasicPNGImage() { stbi_image_free(pixels_); }
+
+template <class Format> int BasicPNGImage<Format>::width() const { return width_; }
+
+template <class Format> int BasicPNGImage<Format>::height() const { return height_; }
+
+template <class Format> Box BasicPNGImage<Format>::region() const {
+    return { { left_, top_ }, { left_ + width_ - 1, top_ + height_ - 1 } };
 }
 
-PNGImage::~PNGImage() { stbi_image_free(pixels_); }
+template <class Format> void BasicPNGImage<Format>::paste(const BasicPNGImage &tile) {
+    int x_from = std::max(tile.left_, left_);
+    int x_to   = std::min(tile.left_ + tile.width_, left_ + width_);
+    if (x_from >= x_to) { return; }
+    int y_from = std::max(tile.top_, top_);
+    int y_to   = std::min(tile.top_ + tile.height_, top_ + height_);
+    for (int y = y_from; y < y_to; y++) {
+        ::memcpy(
+            &pixels_[(y - top_) * width_ + (x_from - left_)],
+            &tile.pixels_[(y - tile.top_) * tile.width_ + (x_from - tile.left_)],
+            (x_to - x_from) * sizeof(Pixel)
+        );
+    }
+}
 
-int PNGImage::width() const { return width_; }
+template <class Format> void BasicPNGImage<Format>::fill_span(int y, int x_from, int x_to, const Color &c) {
+    fill_pixel_span(y, x_from, x_to, Format::pack(c));
+}
 
-int PNGImage::height() const { return height_; }
+template <class Format> void BasicPNGImage<Format>::fill_pixel_span(int y, int x_from, int x_to, const Pixel &p) {
+    if (x_from > x_to) { std::swap(x_from, x_to); }
+    // The image holding the first pixel of the span on the canvas counts it
+    bool first = x_from >= left_ || left_ == 0;
+    y         -= top_;
+    x_from     = std::max(x_from - left_, 0);
+    x_to       = std::min(x_to - left_, width_ - 1);
+    if (y < 0 || y >= height_ || x_from > x_to) { return; }
+    fill_pixels(&pixels_[y * width_ + x_from], x_to - x_from + 1, p);
+    if (counters_) {
+        counters_->pixels += x_to - x_from + 1;
+        if (first) { counters_->spans++; }
+        if (uint32_t *writes = counters_->writes) {
+            writes += (size_t)(y + top_) * counters_->stride + left_;
+            for (int x = x_from; x <= x_to; x++) writes[x]++;
+        }
+    }
+}
 
-Color &PNGImage::at(int x, int y) {
+template <class Format> void BasicPNGImage<Format>::plot(int x, int y, const Pixel &p) {
+    x -= left_;
+    y -= top_;
+    if (x < 0 || x >= width_ || y < 0 || y >= height_) { return; }
+    pixels_[y * width_ + x] = p;
+}
+
+template <class Format> typename BasicPNGImage<Format>::Pixel &BasicPNGImage<Format>::at(int x, int y) {
     assert(x >= 0 && x < width_);
     assert(y >= 0 && y < height_);
     return pixels_[y * width_ + x];
 }
 
-Color PNGImage::at(int x, int y) const {
+template <class Format> typename BasicPNGImage<Format>::Pixel BasicPNGImage<Format>::at(int x, int y) const {
     assert(x >= 0 && x < width_);
     assert(y >= 0 && y < height_);
     return pixels_[y * width_ + x];
 }
 
-void PNGImage::draw_line(const Point &a, const Point &b, const Color &c) {
-    //  Bresenham Algorithm.
-    int x_from = a.x;
-    int y_from = a.y;
-    int x_to   = b.x;
-    int y_to   = b.y;
-    int dy     = y_to - y_from;
-    int dx     = x_to - x_from;
-    int step_x = 1, step_y = 1;
-    if (dy < 0) {
-        dy     = -dy;
-        step_y = -1;
-    }
-    if (dx < 0) {
-        dx     = -dx;
-        step_x = -1;
-    }
-    dy                 *= 2;
-    dx                 *= 2;
-    at(x_from, y_from)  = c;
-    if (dx > dy) {
-        int fraction = dy - (dx / 2);
-        while (x_from != x_to) {
-            if (fraction >= 0) {
-                y_from   += step_y;
-                fraction -= dx;
-            }
-            x_from             += step_x;
-            fraction           += dy;
-            at(x_from, y_from)  = c;
-        }
+namespace {
+//! Division rounding towards minus infinity.
+//! @param a Dividend.
+//! @param b Divisor, positive.
+//! @return Quotient.
+long long floor_div(long long a, long long b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+//! Division rounding towards plus infinity.
+//! @param a Dividend.
+//! @param b Divisor, positive.
+//! @return Quotient.
+long long ceil_div(long long a, long long b) { return -floor_div(-a, b); }
+} // namespace
+
+template <class Format> void BasicPNGImage<Format>::draw_line(const Point &a, const Point &b, const Color &c) {
+    draw_pixel_line(a, b, Format::pack(c));
+}
+
+template <class Format> void BasicPNGImage<Format>::draw_pixel_line(const Point &a, const Point &b, const Pixel &p) {
+    //  Bresenham Algorithm, along the major axis u with the minor axis v.
+    //  After k steps, v has moved m(k) = floor((k dv + du / 2) / du) times,
+    //  so the steps that land inside the image are found without walking
+    //  the part of the line outside of it.
+    int       dx = b.x - a.x, dy = b.y - a.y;
+    bool      x_major = std::abs(dx) > std::abs(dy);
+    int       u0 = x_major ? a.x : a.y, v0 = x_major ? a.y : a.x;
+    int       su = (x_major ? dx : dy) < 0 ? -1 : 1, sv = (x_major ? dy : dx) < 0 ? -1 : 1;
+    long long du = 2 * (long long)std::abs(x_major ? dx : dy);
+    long long dv = 2 * (long long)std::abs(x_major ? dy : dx);
+    long long n  = du / 2;
+    long long h  = du / 2;
+
+    // Image bounds on each axis, relative to the start and in the step direction
+    int u_min = x_major ? left_ : top_, u_max = u_min + (x_major ? width_ : height_) - 1;
+    int v_min = x_major ? top_ : left_, v_max = v_min + (x_major ? height_ : width_) - 1;
+    long long k_from = su > 0 ? (long long)u_min - u0 : (long long)u0 - u_max;
+    long long k_to   = su > 0 ? (long long)u_max - u0 : (long long)u0 - u_min;
+    long long m_from = sv > 0 ? (long long)v_min - v0 : (long long)v0 - v_max;
+    long long m_to   = sv > 0 ? (long long)v_max - v0 : (long long)v0 - v_min;
+    k_from = std::max(k_from, 0LL);
+    k_to   = std::min(k_to, n);
+    if (dv == 0) {
+        if (m_from > 0 || m_to < 0) { return; }
     } else {
-        int fraction = dx - (dy >> 1);
-        while (y_from != y_to) {
-            if (fraction >= 0) {
-                x_from   += step_x;
-                fraction -= dy;
-            }
-            y_from             += step_y;
-            fraction           += dx;
-            at(x_from, y_from)  = c;
+        k_from = std::max(k_from, ceil_div(m_from * du - h, dv));
+        k_to   = std::min(k_to, ceil_div((m_to + 1) * du - h, dv) - 1);
+    }
+    if (k_from > k_to) { return; }
+    if (counters_) { counters_->pixels += k_to - k_from + 1; }
+    uint32_t *writes = counters_ ? counters_->writes : nullptr;
+
+    long long m        = du ? (k_from * dv + h) / du : 0;
+    long long fraction = dv - h + k_from * dv - m * du;
+    int       u        = u0 + su * (int)k_from;
+    int       v        = v0 + sv * (int)m;
+    for (long long k = k_from;; k++) {
+        if (x_major) {
+            plot(u, v, p);
+        } else {
+            plot(v, u, p);
+        }
+        if (writes) { writes[(size_t)(x_major ? v : u) * counters_->stride + (x_major ? u : v)]++; }
+        if (k == k_to) { break; }
+        if (fraction >= 0) {
+            v        += sv;
+            fraction -= du;
         }
+        u        += su;
+        fraction += dv;
     }
 }
 
-void PNGImage::draw_polygon(const std::vector<Point> &points, const Color &c) {
-    int x_min = width(), x_max = 0, y_min = height(), y_max = 0;
-    for (const Point &p : points) {
-        x_min = std::min(x_min, p.x);
-        x_max = std::max(x_max, p.x);
-        y_min = std::min(y_min, p.y);
-        y_max = std::max(y_max, p.y);
+namespace {
+//! Polygon edge crossing at least one scanline.
+struct ScanEdge {
+    //! Edge end points, in polygon order.
+    Point  a, b;
+    //! First and last scanline crossed.
+    int    y_top, y_bottom;
+    //! Intersection with the current scanline.
+    double x;
+};
+} // namespace
+
+template <class Format>
+void BasicPNGImage<Format>::draw_polygon(const std::vector<Point> &points, const Color &c) {
+    draw_polygon(PointArray(points), c);
+}
+
+template <class Format> void BasicPNGImage<Format>::draw_polygon(const PointView &points, const Color &c) {
+    const Pixel p = Format::pack(c);
+    // Only scanlines inside the image can produce visible spans.
+    int y_min = top_ + height_, y_max = top_;
+    for (size_t i = 0; i < points.size(); i++) {
+        y_min = std::min(y_min, points.y[i]);
+        y_max = std::max(y_max, points.y[i]);
+    }
+    y_min = std::max(y_min, top_);
+    y_max = std::min(y_max, top_ + height_);
+
+    // Edge table sorted by first scanline.
+    // Horizontal edges never intersect a scanline.
+    std::vector<ScanEdge> edges;
+    for (size_t i = 0; i < points.size(); i++) {
+        Point a = points.at(i);
+        Point b = points.at((i + 1) % points.size());
+        if (a.y != b.y) {
+            edges.push_back({ a, b, std::min(a.y, b.y), std::max(a.y, b.y), 0 });
+        }
     }
+    std::sort(edges.begin(), edges.end(), [](const ScanEdge &e1, const ScanEdge &e2) {
+        return e1.y_top < e2.y_top;
+    });
 
-    std::vector<double> seg;
+    // Active edges, kept sorted by intersection.
+    std::vector<ScanEdge *> active;
+    size_t                  next = 0;
     for (int y = y_min; y < y_max; y++) {
-        for (size_t i = 0; i < points.size(); i++) {
-            Point a = points[i];
-            Point b = points[(i + 1) % points.size()];
-            if (y < std::min(a.y, b.y) || y > std::max(a.y, b.y)) { continue; }
-            if (a.y != b.y) {
-                double x_inters
-                    = (double)(y - a.y) * (b.x - a.x) / (double)(b.y - a.y)
-                      + a.x;
-                seg.push_back(x_inters);
+        while (next < edges.size() && edges[next].y_top <= y) {
+            active.push_back(&edges[next++]);
+        }
+        active.erase(
+            std::remove_if(
+                active.begin(), active.end(),
+                [y](const ScanEdge *e) { return e->y_bottom < y; }
+            ),
+            active.end()
+        );
+        // Intersections are computed from the end points, as an
+        // incremental update would round differently.
+        for (ScanEdge *e : active) {
+            const Point &a = e->a, &b = e->b;
+            e->x = (double)(y - a.y) * (b.x - a.x) / (double)(b.y - a.y) + a.x;
+        }
+        // Intersections move little from one scanline to the next,
+        // so insertion sort runs in about linear time.
+        for (size_t i = 1; i < active.size(); i++) {
+            ScanEdge *e = active[i];
+            size_t    j = i;
+            for (; j > 0 && active[j - 1]->x > e->x; j--) {
+                active[j] = active[j - 1];
             }
+            active[j] = e;
         }
-        std::sort(seg.begin(), seg.end());
         size_t i_s = 0;
-        while ((i_s + 1) < seg.size()) {
-            Point a = { (int)round(seg.at(i_s)), y };
-            Point b = { (int)round(seg.at(i_s + 1)), y };
-            if (a.x == b.x) {
+        while ((i_s + 1) < active.size()) {
+            int x_from = (int)round(active[i_s]->x);
+            int x_to   = (int)round(active[i_s + 1]->x);
+            if (x_from == x_to) {
                 i_s++;
             } else {
-                draw_line(a, b, c);
+                fill_pixel_span(y, x_from, x_to, p);
                 i_s += 2;
             }
         }
-        seg.clear();
     }
     for (size_t i = 0; i < points.size(); i++) {
-        draw_line(points[i], points[(i + 1) % points.size()], c);
+        draw_pixel_line(points.at(i), points.at((i + 1) % points.size()), p);
     }
 }
 
-void PNGImage::draw_ellipse(
+template <class Format>
+void BasicPNGImage<Format>::draw_ellipse(
     const Point &center, const Point &radius, const Color &fill
 ) {
-    draw_line(
-        center.translate({ -radius.x, 0 }), center.translate({ +radius.x, 0 }),
-        fill
-    );
+    int rx = std::abs(radius.x);
+    if (center.x + rx < left_ || center.x - rx >= left_ + width_) { return; }
+    const Pixel p = Format::pack(fill);
+    fill_pixel_span(center.y, center.x - radius.x, center.x + radius.x, p);
+    // Rows below y = d are needed to find the span widths, rows after it are all outside the image.
+    int d  = std::min(radius.y, std::max(center.y - top_, top_ + height_ - 1 - center.y));
     int x0 = radius.x;
     int dx = 0;
-    for (int y = 1; y <= radius.y; y++) {
+    for (int y = 1; y <= d; y++) {
         double vy  = (double)y / (double)radius.y;
         vy        *= vy;
         int x1     = x0 - (dx - 1);
@@ -162,13 +448,13 @@ void PNGImage::draw_ellipse(
         }
         dx = x0 - x1;
         x0 = x1;
-        draw_line(
-            center.translate({ -x0, -y }), center.translate({ +x0, -y }), fill
-        );
-        draw_line(
-            center.translate({ -x0, +y }), center.translate({ +x0, +y }), fill
-        );
+        fill_pixel_span(center.y - y, center.x - x0, center.x + x0, p);
+        fill_pixel_span(center.y + y, center.x - x0, center.x + x0, p);
     }
 }
 
+template class BasicPNGImage<RGB888>;
+template class BasicPNGImage<RGBA8888>;
+template class BasicPNGImage<Gray8>;
+
 } // namespace svg
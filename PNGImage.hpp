@@ -3,53 +3,210 @@
 #define __svg_png_image_hpp__
 
 #include "Color.hpp"
+#include "PNGEncoder.hpp"
 #include "Point.hpp"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
 namespace svg {
-//! PNG image.
-class PNGImage {
+//! Counters of the pixels drawn on an image.
+struct DrawCounters {
+    //! Pixels written, each time a pixel is painted over.
+    unsigned long long pixels;
+    //! Horizontal runs of pixels filled, each counted by the image holding
+    //! its first pixel on the canvas, which starts at x = 0, so the images
+    //! covering disjoint regions of a canvas count a run once between them.
+    unsigned long long spans;
+    //! Writes to each canvas pixel, row by row, or nullptr not to count them.
+    //! Images covering disjoint regions of a canvas may share it.
+    uint32_t          *writes;
+    //! Pixels per row of writes.
+    int                stride;
+
+    DrawCounters() : pixels(0), spans(0), writes(nullptr), stride(0) {}
+};
+
+//! Pixel format of 3 bytes per pixel: red, green and blue.
+struct RGB888 {
+    //! Pixel in memory.
+    typedef Color Pixel;
+    //! Channels of the pixels in memory.
+    static const int CHANNELS     = 3;
+    //! Channels of the pixels in PNG files.
+    static const int PNG_CHANNELS = 3;
+    //! Pixel of a color.
+    //! @param c Color.
+    //! @return Pixel.
+    static Pixel pack(const Color &c) { return c; }
+    //! Bytes of a row in a PNG file, which are the pixels themselves.
+    //! @param row Pixels of the row.
+    //! @return Bytes of the row.
+    static const unsigned char *png_row(const Pixel *row, size_t, unsigned char *) {
+        return (const unsigned char *)row;
+    }
+};
+
+//! Pixel format of 4 bytes per pixel: red, green, blue and alpha, always
+//! opaque. Pixels are aligned to 4 bytes, so runs are filled with aligned
+//! vector stores, and are saved without the alpha channel.
+struct RGBA8888 {
+    //! Pixel in memory.
+    struct alignas(4) Pixel {
+        //! Red component.
+        rgb_value red;
+        //! Green component.
+        rgb_value green;
+        //! Blue component.
+        rgb_value blue;
+        //! Alpha component.
+        rgb_value alpha;
+    };
+    //! Channels of the pixels in memory.
+    static const int CHANNELS     = 4;
+    //! Channels of the pixels in PNG files.
+    static const int PNG_CHANNELS = 3;
+    //! Pixel of a color.
+    //! @param c Color.
+    //! @return Pixel.
+    static Pixel pack(const Color &c) { return { c.red, c.green, c.blue, 255 }; }
+    //! Bytes of a row in a PNG file, converted to RGB.
+    //! @param row Pixels of the row.
+    //! @param n Number of pixels.
+    //! @param buffer Room for the 3 * n bytes.
+    //! @return Bytes of the row, in the buffer.
+    static const unsigned char *png_row(const Pixel *row, size_t n, unsigned char *buffer) {
+        for (size_t i = 0; i < n; i++) {
+            buffer[3 * i]     = row[i].red;
+            buffer[3 * i + 1] = row[i].green;
+            buffer[3 * i + 2] = row[i].blue;
+        }
+        return buffer;
+    }
+};
+
+//! Pixel format of 1 byte per pixel: the luma of the color, computed as
+//! stb_image converts RGB images to grey. For masks and previews.
+struct Gray8 {
+    //! Pixel in memory.
+    typedef rgb_value Pixel;
+    //! Channels of the pixels in memory.
+    static const int CHANNELS     = 1;
+    //! Channels of the pixels in PNG files.
+    static const int PNG_CHANNELS = 1;
+    //! Pixel of a color.
+    //! @param c Color.
+    //! @return Pixel.
+    static Pixel pack(const Color &c) { return (Pixel)((c.red * 77 + c.green * 150 + c.blue * 29) >> 8); }
+    //! Bytes of a row in a PNG file, which are the pixels themselves.
+    //! @param row Pixels of the row.
+    //! @return Bytes of the row.
+    static const unsigned char *png_row(const Pixel *row, size_t, unsigned char *) { return row; }
+};
+
+//! Pixel formats, to choose one at run time.
+enum class PixelFormat { RGB888, RGBA8888, Gray8 };
+
+//! Parse the name of a pixel format.
+//! @param name "rgb", "rgba" or "gray".
+//! @return The pixel format.
+PixelFormat parse_pixel_format(const std::string &name);
+
+//! PNG image, stored in a pixel format given at compile time: the drawing
+//! functions convert their color once and write pixels of the format.
+//! Instantiated for RGB888, RGBA8888 and Gray8.
+//! @tparam Format Pixel format.
+template <class Format> class BasicPNGImage {
   public:
-    //! Constructor that loads image from a file.
+    //! Pixel in memory.
+    typedef typename Format::Pixel Pixel;
+    //! Constructor that loads image from a file, converting it to the format.
     //! @param png_file_name File name.
-    PNGImage(const std::string &png_file_name);
+    BasicPNGImage(const std::string &png_file_name);
+    //! Constructor that decodes a PNG file in memory, converting it to the format.
+    //! @param png PNG file.
+    //! @param size Size of the file in bytes.
+    BasicPNGImage(const unsigned char *png, size_t size);
     //! Constructor of blank image.
     //! Initally, all pixels will be white.
     //! @param w Image width.
     //! @param h Image height.
-    PNGImage(int w, int h);
+    BasicPNGImage(int w, int h);
+    //! Constructor of blank image covering a region of a larger canvas.
+    //! Drawing functions take canvas coordinates and discard
+    //! pixels outside the region. Initally, all pixels will be white.
+    //! @param x X position of the region in the canvas.
+    //! @param y Y position of the region in the canvas.
+    //! @param w Region width.
+    //! @param h Region height.
+    BasicPNGImage(int x, int y, int w, int h);
     //! Destructor.
-    ~PNGImage();
+    ~BasicPNGImage();
+    //! Turn into a blank image of another size, reusing the pixel
+    //! buffer when it is large enough. All pixels will be white.
+    //! @param w Image width.
+    //! @param h Image height.
+    void   reset(int w, int h);
     //! Get image width.
     //! @return The image width.
     int    width() const;
     //! Get image height.
     //! @return The image height.
     int    height() const;
+    //! Get canvas area covered by the image.
+    //! @return Box of canvas pixels.
+    Box    region() const;
     //! Get mutable reference to image pixel.
     //! @param x X position
     //! @param y Y position.
     //! @return Reference to pixel.
-    Color &at(int x, int y);
+    Pixel &at(int x, int y);
     //! Get const reference to image pixel.
     //! @param x X position
     //! @param y Y position.
     //! @return Reference to pixel.
-    Color  at(int x, int y) const;
-    //! Save to output file.
+    Pixel  at(int x, int y) const;
+    //! Pixels of a row, in memory order.
+    //! @param y Y position.
+    //! @return First pixel of the row, followed by the others.
+    const Pixel *row(int y) const { return pixels_ + (size_t)y * width_; }
+    //! Save to output file, with the channels of the format.
     //! @param png_file_name Output file name.
     void   save(const std::string &png_file_name) const;
+    //! Save to output file with the multithreaded encoder, see encode_png().
+    //! @param png_file_name Output file name.
+    //! @param options Encoder settings.
+    void   save(const std::string &png_file_name, const PNGOptions &options) const;
+    //! Count the pixels drawn from now on, which costs an addition per
+    //! span or line drawn.
+    //! @param counters Counters to add to, nullptr to stop counting.
+    void   count(DrawCounters *counters) { counters_ = counters; }
+    //! Get the counters of the pixels drawn.
+    //! @return Counters being added to, nullptr if not counting.
+    DrawCounters *counters() const { return counters_; }
+    //! Copy the pixels of an image covering a region of this canvas.
+    //! @param tile Image to copy, positioned by its region.
+    void   paste(const BasicPNGImage &tile);
     //! Draw a line defined by 2 points.
     //! @param a First point.
     //! @param b Second point.
     //! @param c Color to use for the line.
     void   draw_line(const Point &a, const Point &b, const Color &c);
+    //! Fill a horizontal run of pixels, clipped to the image.
+    //! @param y Y position.
+    //! @param x_from X position of one end of the run.
+    //! @param x_to X position of the other end of the run (included).
+    //! @param c Color to use for the run.
+    void   fill_span(int y, int x_from, int x_to, const Color &c);
     //! Draw a polygon.
     //! @param points Vector of points defining the polygon.
     //! @param fill Color to use for the polygon fill.
     void   draw_polygon(const std::vector<Point> &points, const Color &fill);
+    //! Draw a polygon.
+    //! @param points Sequence of points defining the polygon.
+    //! @param fill Color to use for the polygon fill.
+    void   draw_polygon(const PointView &points, const Color &fill);
     //! Draw an ellipse.
     //! @param center Coordinates for the ellipse center.
     //! @param radius Radius in X and Y axis.
@@ -59,13 +216,48 @@ class PNGImage {
     draw_ellipse(const Point &center, const Point &radius, const Color &fill);
 
   private:
+    //! Fill a horizontal run of pixels with a pixel of the format.
+    //! @param y Y position.
+    //! @param x_from X position of one end of the run.
+    //! @param x_to X position of the other end of the run (included).
+    //! @param p Pixel.
+    void   fill_pixel_span(int y, int x_from, int x_to, const Pixel &p);
+    //! Draw a line with a pixel of the format.
+    //! @param a First point.
+    //! @param b Second point.
+    //! @param p Pixel.
+    void   draw_pixel_line(const Point &a, const Point &b, const Pixel &p);
+    //! Set a pixel, given in canvas coordinates, if it lies in the image.
+    //! @param x X position.
+    //! @param y Y position.
+    //! @param p Pixel.
+    void   plot(int x, int y, const Pixel &p);
+    //! X position in the canvas.
+    int    left_;
+    //! Y position in the canvas.
+    int    top_;
     //! Width.
     int    width_;
     //! Height.
     int    height_;
+    //! Number of pixels the buffer can hold.
+    size_t capacity_;
     //! Pixels.
-    Color *pixels_;
+    Pixel *pixels_;
+    //! Counters of the pixels drawn, nullptr if not counting.
+    DrawCounters *counters_;
 };
+
+extern template class BasicPNGImage<RGB888>;
+extern template class BasicPNGImage<RGBA8888>;
+extern template class BasicPNGImage<Gray8>;
+
+//! PNG image of 3 bytes per pixel.
+typedef BasicPNGImage<RGB888>   PNGImage;
+//! PNG image of 4 bytes per pixel.
+typedef BasicPNGImage<RGBA8888> PNGImageRGBA;
+//! PNG image of 1 grey byte per pixel.
+typedef BasicPNGImage<Gray8>    PNGImageGray;
 } // namespace svg
 
 #endif
@@ -0,0 +1,22 @@
+#include "Parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace svg {
+
+void parallelFor(size_t n, unsigned threads, const std::function<void(size_t)> &task) {
+    std::atomic<size_t> next(0);
+    auto                worker = [&]() {
+        for (size_t i = next++; i < n; i = next++) task(i);
+    };
+
+    if (threads == 0) { threads = std::max(1u, std::thread::hardware_concurrency()); }
+    threads = std::min<size_t>(threads, n);
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker(); // The calling thread works too
+    for (std::thread &t : pool) t.join();
+}
+} // namespace svg
@@ -0,0 +1,17 @@
+/// @file Parallel.hpp
+#ifndef __svg_Parallel_hpp__
+#define __svg_Parallel_hpp__
+
+#include <cstddef>
+#include <functional>
+
+namespace svg {
+
+/// @brief          Run a task for each index on a pool of threads. The calling
+///                 thread works too, and tasks are taken in increasing order.
+/// @param n        Number of tasks
+/// @param threads  Number of threads (0 uses one per hardware thread)
+/// @param task     Task, called with the index
+void parallelFor(size_t n, unsigned threads, const std::function<void(size_t)> &task);
+} // namespace svg
+#endif
@@ -1,5 +1,7 @@
 //! @file point.cpp
 #include "Point.hpp"
+#include <algorithm>
+#include <climits>
 #include <cmath>
 
 namespace svg {
@@ -20,4 +22,48 @@ Point Point::scale(const Point &origin, int v) const {
     return { origin.x + (x - origin.x) * v, origin.y + (y - origin.y) * v };
 }
 
+PointArray::PointArray(const std::vector<Point> &points) {
+    for (const Point &p : points) {
+        x.push_back(p.x);
+        y.push_back(p.y);
+    }
+}
+
+PointArray::PointArray(std::initializer_list<Point> points)
+    : PointArray(std::vector<Point>(points)) {}
+
+void PointArray::resize(size_t n) {
+    x.resize(n);
+    y.resize(n);
+}
+
+std::vector<Point> PointArray::to_vector() const {
+    std::vector<Point> points(size());
+    for (size_t i = 0; i < size(); i++) points[i] = at(i);
+    return points;
+}
+
+Box Box::empty() { return { { INT_MAX, INT_MAX }, { INT_MIN, INT_MIN } }; }
+
+bool Box::is_empty() const { return min.x > max.x || min.y > max.y; }
+
+Box Box::extend(const Point &p) const {
+    return { { std::min(min.x, p.x), std::min(min.y, p.y) }, { std::max(max.x, p.x), std::max(max.y, p.y) } };
+}
+
+Box Box::unite(const Box &b) const {
+    if (b.is_empty()) { return *this; }
+    return extend(b.min).extend(b.max);
+}
+
+Box Box::intersect(const Box &b) const {
+    return { { std::max(min.x, b.min.x), std::max(min.y, b.min.y) },
+             { std::min(max.x, b.max.x), std::min(max.y, b.max.y) } };
+}
+
+bool Box::intersects(const Box &b) const {
+    return !is_empty() && !b.is_empty() && min.x <= b.max.x && b.min.x <= max.x && min.y <= b.max.y
+           && b.min.y <= max.y;
+}
+
 } // namespace svg
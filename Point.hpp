@@ -2,6 +2,10 @@
 #ifndef __svg_point_hpp__
 #define __svg_point_hpp__
 
+#include <cstddef>
+#include <initializer_list>
+#include <vector>
+
 namespace svg {
 //! 2D Point struct, with a few convenience member functions (can be defined for
 //! structs too).
@@ -26,5 +30,94 @@ struct Point {
     //! @return Scaling result.
     Point scale(const Point &origin, int v) const;
 };
+
+//! Sequence of points stored as separate X and Y arrays
+//! (structure of arrays), for batch processing.
+struct PointArray {
+    //! X coordinates.
+    std::vector<int> x;
+    //! Y coordinates.
+    std::vector<int> y;
+
+    //! Constructor of empty sequence.
+    PointArray() {}
+    //! Constructor from a vector of points.
+    //! @param points Points.
+    PointArray(const std::vector<Point> &points);
+    //! Constructor from a list of points.
+    //! @param points Points.
+    PointArray(std::initializer_list<Point> points);
+    //! Get number of points.
+    //! @return The number of points.
+    size_t size() const { return x.size(); }
+    //! Get a point.
+    //! @param i Index.
+    //! @return Point at the index.
+    Point  at(size_t i) const { return { x[i], y[i] }; }
+    //! Change the number of points.
+    //! @param n Number of points.
+    void   resize(size_t n);
+    //! Get the points as a vector of points.
+    //! @return Vector of points.
+    std::vector<Point> to_vector() const;
+};
+
+//! Read-only view of points stored as separate X and Y arrays.
+struct PointView {
+    //! X coordinates.
+    const int *x;
+    //! Y coordinates.
+    const int *y;
+    //! Number of points.
+    size_t     n;
+
+    //! Constructor from arrays of coordinates.
+    //! @param xs X coordinates.
+    //! @param ys Y coordinates.
+    //! @param count Number of points.
+    PointView(const int *xs, const int *ys, size_t count) : x(xs), y(ys), n(count) {}
+    //! Constructor from a sequence of points, valid while it is not changed.
+    //! @param points Points.
+    PointView(const PointArray &points) : x(points.x.data()), y(points.y.data()), n(points.size()) {}
+    //! Get number of points.
+    //! @return The number of points.
+    size_t size() const { return n; }
+    //! Get a point.
+    //! @param i Index.
+    //! @return Point at the index.
+    Point  at(size_t i) const { return { x[i], y[i] }; }
+};
+
+//! Axis-aligned box of pixels, with inclusive corners.
+//! A box whose minimum exceeds its maximum is empty.
+struct Box {
+    //! Top-left corner.
+    Point min;
+    //! Bottom-right corner.
+    Point max;
+
+    //! Build an empty box.
+    //! @return Box containing no pixels.
+    static Box empty();
+    //! Check if the box contains no pixels.
+    //! @return true if the box is empty.
+    bool is_empty() const;
+    //! Smallest box containing this box and a point.
+    //! @param p Point to include.
+    //! @return Extended box.
+    Box extend(const Point &p) const;
+    //! Smallest box containing both boxes.
+    //! @param b Other box.
+    //! @return Union of the boxes.
+    Box unite(const Box &b) const;
+    //! Pixels shared by both boxes.
+    //! @param b Other box.
+    //! @return Intersection of the boxes, possibly empty.
+    Box intersect(const Box &b) const;
+    //! Check if two boxes share at least one pixel.
+    //! @param b Other box.
+    //! @return true if the boxes intersect.
+    bool intersects(const Box &b) const;
+};
 } // namespace svg
 #endif
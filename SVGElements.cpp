@@ -1,47 +1,89 @@
 #include "SVGElements.hpp"
+#include "DisplayList.hpp"
+#include <algorithm>
+#include <cstring>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace svg {
 
 //* BASE ELEMENT
 
-SVGElement::SVGElement(const std::string &id, const std::vector<Transform> &t) : id_(id), transforms_(t) {}
+SVGElement::SVGElement(Arena &arena, const std::string &id, const Transform &t)
+    : id_(arena.copy(id)), transform_(t), box_(Box::empty()) {}
 
 SVGElement::~SVGElement() {}
 
-std::string SVGElement::getID() const { return id_; }
-
 //
 
 
 //* ELLIPSE && CIRCLE
 
 Ellipse::Ellipse(
-    const std::string &id, const std::vector<Transform> &t, const Color &fill, const Point &center, const Point &radius
+    Arena &arena, const std::string &id, const Transform &t, const Color &fill, const Point &center, const Point &radius
 )
-    : SVGElement(id, t), color_(fill), center_(center), radius_(radius) {}
+    : SVGElement(arena, id, t), color_(fill), center_(center), radius_(radius) {
+    computeBounds();
+}
 
 Circle::Circle(
-    const std::string &id, const std::vector<Transform> &t, const Color &fill, const Point &center, int radius
+    Arena &arena, const std::string &id, const Transform &t, const Color &fill, const Point &center, int radius
 )
-    : Ellipse(id, t, fill, center, Point{ radius, radius }) {}
+    : Ellipse(arena, id, t, fill, center, Point{ radius, radius }) {}
 
 //
 
 
 //* POLYLINE
 
+/// @brief          Copy points to an arena
+/// @param arena    Arena
+/// @param points   Points
+/// @return         View of the copy
+static PointView copyPoints(Arena &arena, const PointArray &points) {
+    size_t n = points.size();
+    return PointView(arena.copy(points.x.data(), n), arena.copy(points.y.data(), n), n);
+}
+
+/// @brief          Replace the points of an element, writing over its own copy
+///                 when the new points fit in it
+/// @param arena    Arena
+/// @param view     Points of the element, copied with copyPoints
+/// @param capacity Number of points the copy holds, updated when it grows
+/// @param points   New points
+static void replacePoints(Arena &arena, PointView &view, size_t &capacity, const PointArray &points) {
+    size_t n = points.size();
+    if (n > capacity) {
+        view     = copyPoints(arena, points);
+        capacity = n;
+        return;
+    }
+    // The copy was made by copyPoints in the arena and belongs to the element.
+    if (n) {
+        std::memcpy(const_cast<int *>(view.x), points.x.data(), n * sizeof(int));
+        std::memcpy(const_cast<int *>(view.y), points.y.data(), n * sizeof(int));
+    }
+    view.n = n;
+}
+
 PolyLine::PolyLine(
-    const std::string &id, const std::vector<Transform> &t, const std::vector<Point> &points, const Color &stroke
+    Arena &arena, const std::string &id, const Transform &t, const PointArray &points, const Color &stroke
 )
-    : SVGElement(id, t), color_(stroke), points_(points) {}
+    : SVGElement(arena, id, t), color_(stroke), points_(copyPoints(arena, points)), capacity_(points.size()) {
+    computeBounds();
+}
+
+void PolyLine::setPoints(Arena &arena, const PointArray &points) {
+    replacePoints(arena, points_, capacity_, points);
+    computeBounds();
+}
 
 Line::Line(
-    const std::string &id, const std::vector<Transform> &t, const Point &point1, const Point &point2,
+    Arena &arena, const std::string &id, const Transform &t, const Point &point1, const Point &point2,
     const Color &stroke
 )
-    : PolyLine(id, t, { point1, point2 }, stroke) {}
+    : PolyLine(arena, id, t, { point1, point2 }, stroke) {}
 
 //
 
@@ -49,16 +91,23 @@ Line::Line(
 //* POLYGON
 
 PolyGon::PolyGon(
-    const std::string &id, const std::vector<Transform> &t, const std::vector<Point> &points, const Color &fill
+    Arena &arena, const std::string &id, const Transform &t, const PointArray &points, const Color &fill
 )
-    : SVGElement(id, t), color_(fill), points_(points) {}
+    : SVGElement(arena, id, t), color_(fill), points_(copyPoints(arena, points)), capacity_(points.size()) {
+    computeBounds();
+}
+
+void PolyGon::setPoints(Arena &arena, const PointArray &points) {
+    replacePoints(arena, points_, capacity_, points);
+    computeBounds();
+}
 
 Rectangle::Rectangle(
-    const std::string &id, const std::vector<Transform> &t, const Color &fill, const Point &origin, int width,
+    Arena &arena, const std::string &id, const Transform &t, const Color &fill, const Point &origin, int width,
     int height
 )
     : PolyGon(
-        id, t,
+        arena, id, t,
         {
             origin,
             {origin.x + width - 1,              origin.y},
@@ -74,144 +123,287 @@ Rectangle::Rectangle(
 //* GROUP && USE
 
 GroupElement::GroupElement(
-    const std::string &id, const std::vector<Transform> &t, const std::vector<SVGElement *> &elems
+    Arena &arena, const std::string &id, const Transform &t, SVGElement *const *elems, size_t count
 )
-    : SVGElement(id, t), elems_(elems) {}
-
-GroupElement::~GroupElement() {
-    for (SVGElement *elem : elems_) delete elem;
+    : SVGElement(arena, id, t), elems_(arena.copy(elems, count)), count_(count) {
+    computeBounds();
 }
 
-UseElement::UseElement(const std::string &id, const std::vector<Transform> &t, const SVGElement *ref)
-    : SVGElement(id, t), ref_(ref) {}
-
-UseElement::~UseElement() { delete ref_; }
+UseElement::UseElement(Arena &arena, const std::string &id, const Transform &t, const SVGElement *ref)
+    : SVGElement(arena, id, t), ref_(ref) {
+    computeBounds();
+}
 
 //
 
 
-//* Copy
+//* Draw
 
+void Ellipse::draw(PNGImage &img, const TransformChain &outer) const {
+    TransformChain chain(transform_, outer);            // Own and inherited Transformations
+    Point          center = chain.apply(center_);       // Transformed center
+    Point          radius = chain.scaleRadius(radius_); // Radius Scales Independent from the origin
 
-SVGElement *Ellipse::copy(const std::vector<Transform> &t) const {
-    // Copy only the transformation applied directly to the object
-    std::vector<Transform> transList;
-    transList.push_back(transforms_[0]);
+    img.draw_ellipse(center, radius, color_); // Draw Ellipse
+}
 
-    // Append Inherited Transformations
-    transList.insert(transList.end(), t.begin(), t.end());
+void PolyLine::draw(PNGImage &img, const TransformChain &outer) const {
+    PointArray points; // Transformed points
 
-    return new Ellipse("", transList, color_, center_, radius_);
+    // Apply the Transformations to all Points of the PolyLine at once
+    TransformChain(transform_, outer).apply(points_, points);
+
+    // Draw each individual segment
+    for (size_t i = 0; i + 1 < points.size(); i++) img.draw_line(points.at(i), points.at(i + 1), color_);
 }
 
-SVGElement *PolyLine::copy(const std::vector<Transform> &t) const {
-    // Copy only the transformation applied directly to the object
-    std::vector<Transform> transList;
-    transList.push_back(transforms_[0]);
+void PolyGon::draw(PNGImage &img, const TransformChain &outer) const {
+    PointArray points; // Transformed points
 
-    // Append Inherited Transformations
-    transList.insert(transList.end(), t.begin(), t.end());
+    // Apply the Transformations to all Points of the PolyGon at once
+    TransformChain(transform_, outer).apply(points_, points);
 
-    return new PolyLine("", transList, points_, color_);
+    img.draw_polygon(points, color_); // Draw Polygon
 }
 
-SVGElement *PolyGon::copy(const std::vector<Transform> &t) const {
-    // Copy only the transformation applied directly to the object
-    std::vector<Transform> transList;
-    transList.push_back(transforms_[0]);
+void GroupElement::draw(PNGImage &img, const TransformChain &outer) const {
+    TransformChain chain(transform_, outer); // Inherited by the children
+    Box            region = img.region();
 
-    // Append Inherited Transformations
-    transList.insert(transList.end(), t.begin(), t.end());
+    // Children, and their whole subtrees, are skipped when they fall outside the image
+    for (size_t i = 0; i < count_; i++) {
+        if (elems_[i]->coarseBounds(chain).intersects(region)) elems_[i]->draw(img, chain);
+    }
+}
 
-    return new PolyGon("", transList, points_, color_);
+void UseElement::draw(PNGImage &img, const TransformChain &outer) const {
+    // The referenced element is drawn as if it was a child of the use
+    TransformChain chain(transform_, outer);
+    if (ref_ && ref_->coarseBounds(chain).intersects(img.region())) ref_->draw(img, chain);
 }
 
-SVGElement *GroupElement::copy(const std::vector<Transform> &t) const {
-    // Copy only the transformation applied directly to the object
-    std::vector<Transform> transList;
-    transList.push_back(transforms_[0]);
+//
 
-    // Append Inherited Transformations
-    transList.insert(transList.end(), t.begin(), t.end());
 
-    // Create copies of the children
-    std::vector<SVGElement *> newElems;
-    for (SVGElement *elem : elems_) newElems.push_back(elem->copy(transList));
+//* Compile
 
-    return new GroupElement("", transList, newElems);
+void Ellipse::compile(DisplayListWriter &out, const TransformChain &outer) const {
+    TransformChain chain(transform_, outer);
+    out.ellipse(chain.apply(center_), chain.scaleRadius(radius_), color_);
 }
 
-SVGElement *UseElement::copy(const std::vector<Transform> &t) const {
-    // Copy only the transformation applied directly to the object
-    std::vector<Transform> transList;
-    transList.push_back(transforms_[0]);
+void PolyLine::compile(DisplayListWriter &out, const TransformChain &outer) const {
+    PointArray points;
+    TransformChain(transform_, outer).apply(points_, points);
+    out.polyline(points, color_);
+}
 
-    // Append Inherited Transformations
-    transList.insert(transList.end(), t.begin(), t.end());
+void PolyGon::compile(DisplayListWriter &out, const TransformChain &outer) const {
+    PointArray points;
+    TransformChain(transform_, outer).apply(points_, points);
+    out.polygon(points, color_);
+}
 
-    // Create copy of the referenced element
-    SVGElement *newEP = ref_->copy(transList);
+void GroupElement::compile(DisplayListWriter &out, const TransformChain &outer) const {
+    TransformChain chain(transform_, outer);
+    for (size_t i = 0; i < count_; i++) elems_[i]->compile(out, chain);
+}
 
-    return new UseElement("", transList, newEP);
+void UseElement::compile(DisplayListWriter &out, const TransformChain &outer) const {
+    if (ref_) ref_->compile(out, TransformChain(transform_, outer));
 }
 
 //
 
 
-//* Draw
+//* Bounds
 
-void Ellipse::draw(PNGImage &img) const {
-    Point center = center_; // Copy of the center
-    Point radius = radius_; // Copy of the radius
+Box Ellipse::bounds(const TransformChain &outer) const {
+    TransformChain chain(transform_, outer);
+    Point          center = chain.apply(center_);
+    Point          radius = chain.scaleRadius(radius_);
 
-    // Apply each Transformation to center
-    for (const Transform t : transforms_) {
-        center = center.translate(t.getTrans());
-        center = center.scale(t.getOrigin(), t.getScale());
-        center = center.rotate(t.getOrigin(), t.getRotate());
+    // Scaling may flip the radius
+    radius = { std::abs(radius.x), std::abs(radius.y) };
+    return Box::empty().extend(center.translate({ -radius.x, -radius.y })).extend(center.translate(radius));
+}
 
-        radius = radius.scale(Point{ 0, 0 }, t.getScale()); // Radius Scales Independent from the origin
-    }
+/// @brief          Bounding box of a sequence of points
+/// @param points   Points
+/// @return         Bounding box
+static Box pointsBounds(const PointView &points) {
+    Box box = Box::empty();
+    for (size_t i = 0; i < points.size(); i++) box = box.extend(points.at(i));
+    return box;
+}
 
-    img.draw_ellipse(center, radius, color_);               // Draw Ellipse
+Box PolyLine::bounds(const TransformChain &outer) const {
+    PointArray points;
+    TransformChain(transform_, outer).apply(points_, points);
+    return pointsBounds(points);
 }
 
-void PolyLine::draw(PNGImage &img) const {
-    std::vector<Point> points = points_; // Copy of the points
+Box PolyGon::bounds(const TransformChain &outer) const {
+    PointArray points;
+    TransformChain(transform_, outer).apply(points_, points);
+    return pointsBounds(points);
+}
+
+Box GroupElement::bounds(const TransformChain &outer) const {
+    TransformChain chain(transform_, outer);
+    Box            box = Box::empty();
+    for (size_t i = 0; i < count_; i++) box = box.unite(elems_[i]->bounds(chain));
+    return box;
+}
+
+Box UseElement::bounds(const TransformChain &outer) const {
+    return ref_ ? ref_->bounds(TransformChain(transform_, outer)) : Box::empty();
+}
 
-    // Apply each Transformation to each Point of the PolyLine
-    for (const Transform t : transforms_) {
-        for (Point &point : points) {
-            point = point.translate(t.getTrans());
-            point = point.scale(t.getOrigin(), t.getScale());
-            point = point.rotate(t.getOrigin(), t.getRotate());
-        }
+void Ellipse::computeBounds() {
+    // A square holds the ellipse under any rotation
+    int r = std::max(std::abs(radius_.x), std::abs(radius_.y));
+    box_  = Box{ center_.translate({ -r, -r }), center_.translate({ r, r }) };
+}
+
+void PolyLine::computeBounds() { box_ = pointsBounds(points_); }
+
+void PolyGon::computeBounds() { box_ = pointsBounds(points_); }
+
+void GroupElement::computeBounds() {
+    // Children bounds in the coordinates of the group, after their own transformation
+    TransformChain root;
+    box_ = Box::empty();
+    for (size_t i = 0; i < count_; i++) box_ = box_.unite(elems_[i]->coarseBounds(root));
+}
+
+void UseElement::computeBounds() { box_ = ref_ ? ref_->coarseBounds(TransformChain()) : Box::empty(); }
+
+/// @brief          Recompute cached bounds in depth first order, each element once
+/// @param element  Element to start from
+/// @param done     Elements already updated, or being updated
+static void updateBounds(SVGElement *element, std::unordered_set<const SVGElement *> &done) {
+    if (!done.insert(element).second) return;
+
+    if (GroupElement *group = dynamic_cast<GroupElement *>(element)) {
+        for (size_t i = 0; i < group->size(); i++) updateBounds(group->child(i), done);
+    } else if (UseElement *use = dynamic_cast<UseElement *>(element)) {
+        // Elements are never const in a document
+        if (use->ref()) updateBounds(const_cast<SVGElement *>(use->ref()), done);
     }
+    element->computeBounds();
+}
 
-    // Draw each individual segment
-    for (size_t i = 0; i < points.size() - 1; i++) img.draw_line(points[i], points[i + 1], color_);
+void updateBounds(const std::vector<SVGElement *> &elements) {
+    std::unordered_set<const SVGElement *> done;
+    for (SVGElement *element : elements) updateBounds(element, done);
 }
 
-void PolyGon::draw(PNGImage &img) const {
-    std::vector<Point> points = points_; // Copy of the points
+//
+
+
+//* Coverage
+
+Box Ellipse::coverage(const TransformChain &outer) const {
+    TransformChain chain(transform_, outer);
+    Point          center = chain.apply(center_);
+    Point          radius = chain.scaleRadius(radius_);
+    if (radius.x <= 0 || radius.y <= 0) return Box::empty();
+
+    // Rows of the ellipse reach the inscribed rectangle of half sides r / sqrt(2), less one pixel of rounding
+    int a = (int)(radius.x * 0.7071) - 1, b = (int)(radius.y * 0.7071) - 1;
+    if (a < 0 || b < 0) return Box::empty();
+    return Box{ center.translate({ -a, -b }), center.translate({ a, b }) };
+}
 
-    // Apply each Transformation to each Point of the PolyGon
-    for (const Transform t : transforms_) {
-        for (Point &point : points) {
-            point = point.translate(t.getTrans());
-            point = point.scale(t.getOrigin(), t.getScale());
-            point = point.rotate(t.getOrigin(), t.getRotate());
-        }
+Box PolyLine::coverage(const TransformChain &) const { return Box::empty(); }
+
+Box PolyGon::coverage(const TransformChain &outer) const {
+    if (points_.size() != 4) return Box::empty();
+    PointArray points;
+    TransformChain(transform_, outer).apply(points_, points);
+
+    // Only rectangles aligned with the axes, which are filled up to their edges:
+    // edges alternate between horizontal and vertical ones
+    for (size_t i = 0; i < 4; i++) {
+        Point a = points.at(i), b = points.at((i + 1) % 4), c = points.at((i + 2) % 4);
+        bool  horizontal = a.y == b.y && a.x != b.x;
+        bool  vertical   = a.x == b.x && a.y != b.y;
+        if (!(horizontal ? c.x == b.x && c.y != b.y : vertical && c.y == b.y && c.x != b.x)) return Box::empty();
     }
+    return pointsBounds(points);
+}
 
-    img.draw_polygon(points, color_); // Draw Polygon
+Box GroupElement::coverage(const TransformChain &outer) const {
+    // The largest box covered by a child
+    TransformChain chain(transform_, outer);
+    Box            best = Box::empty();
+    long long      area = 0;
+    for (size_t i = 0; i < count_; i++) {
+        Box box = elems_[i]->coverage(chain);
+        if (box.is_empty()) continue;
+        long long size = (long long)(box.max.x - box.min.x + 1) * (box.max.y - box.min.y + 1);
+        if (size > area) best = box, area = size;
+    }
+    return best;
 }
 
-void GroupElement::draw(PNGImage &img) const {
-    for (SVGElement *elem : elems_) elem->draw(img);
+Box UseElement::coverage(const TransformChain &outer) const {
+    return ref_ ? ref_->coverage(TransformChain(transform_, outer)) : Box::empty();
 }
 
-void UseElement::draw(PNGImage &img) const { ref_->draw(img); }
+//
+
+
+//* Statistics
+
+const char *Ellipse::tag() const { return "ellipse"; }
+
+const char *Circle::tag() const { return "circle"; }
+
+const char *PolyLine::tag() const { return "polyline"; }
+
+const char *Line::tag() const { return "line"; }
+
+const char *PolyGon::tag() const { return "polygon"; }
+
+const char *Rectangle::tag() const { return "rect"; }
+
+const char *GroupElement::tag() const { return "g"; }
+
+const char *UseElement::tag() const { return "use"; }
+
+size_t Ellipse::vertices() const { return 0; }
+
+size_t PolyLine::vertices() const { return points_.size(); }
+
+size_t PolyGon::vertices() const { return points_.size(); }
+
+size_t GroupElement::vertices() const {
+    size_t n = 0;
+    for (size_t i = 0; i < count_; i++) n += elems_[i]->vertices();
+    return n;
+}
+
+size_t UseElement::vertices() const { return ref_ ? ref_->vertices() : 0; }
+
+//
+
+
+//* Document
+
+SVGElement *Document::find(const std::string &id) const {
+    auto found = ids_.find(id);
+    return found != ids_.end() ? found->second : nullptr;
+}
+
+void Document::clear() {
+    // Elements are only made of arena memory, so they need no destructor calls
+    elements_.clear();
+    ids_.clear();
+    dimensions_ = { 0, 0 };
+    arena_.clear();
+}
 
 
 } // namespace svg
\ No newline at end of file
@@ -2,69 +2,85 @@
 #ifndef __svg_SVGElements_hpp__
 #define __svg_SVGElements_hpp__
 
+#include "Arena.hpp"
 #include "Color.hpp"
 #include "PNGImage.hpp"
 #include "Point.hpp"
+#include "Transform.hpp"
 #include "external/tinyxml2/tinyxml2.h"
+#include <cstdint>
+#include <istream>
+#include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace svg {
 
-class Transform {
-  private:
-    int transX_, transY_;
-    int rotate_;
-    int scale_;
-    int origX_, origY_;
-
-  public:
-    /// @brief      Object that represents a transformation.
-    /// @param tx   Translation in X
-    /// @param ty   Translation in Y
-    /// @param r    Rotation
-    /// @param s    Scale
-    /// @param ox   Origin X
-    /// @param oy   Origin Y
-    Transform(int tx, int ty, int r, int s, int ox, int oy)
-        : transX_(tx), transY_(ty), rotate_(r), scale_(s), origX_(ox), origY_(oy) {}
-
-    /// @return Translation
-    Point getTrans() const { return Point{ transX_, transY_ }; }
-
-    /// @return Rotation
-    int getRotate() const { return rotate_; }
-
-    /// @return Scale
-    int getScale() const { return scale_; }
-
-    /// @return Origin
-    Point getOrigin() const { return Point{ origX_, origY_ }; }
-};
+class DisplayList;
+class DisplayListWriter;
 
+/// Elements are created in the arena of their document and must not own
+/// memory outside of it: strings and arrays are copied into the arena too.
 class SVGElement {
   protected:
-    std::string            id_;
-    std::vector<Transform> transforms_;
+    const char *id_;
+    Transform   transform_;
+    Box         box_; // Cached bounds before the element's own transformation
 
   public:
-    /// @param id   Element's ID
-    /// @param t    Transformations
-    SVGElement(const std::string &id, const std::vector<Transform> &t);
+    /// @param arena    Arena of the document
+    /// @param id       Element's ID
+    /// @param t        Transformation
+    SVGElement(Arena &arena, const std::string &id, const Transform &t);
     virtual ~SVGElement();
 
     /// @brief  Get the ID of the element
-    /// @return Element's ID
-    std::string getID() const;
-
-    /// @brief      Draw Element
-    /// @param img  PNGImage object of the image
-    virtual void draw(PNGImage &img) const = 0;
-
-    /// @brief      Generate a copy of the element
-    /// @param t    Extra Transformations to add
-    /// @return     Pointer to newly created element
-    virtual SVGElement *copy(const std::vector<Transform> &t) const = 0;
+    /// @return Element's ID, valid while the document is not cleared
+    const char *getID() const { return id_; }
+
+    /// @return Transformation of the element
+    const Transform &getTransform() const { return transform_; }
+
+    /// @param t    New transformation of the element
+    void setTransform(const Transform &t) { transform_ = t; }
+
+    /// @brief          Draw Element
+    /// @param img      PNGImage object of the image
+    /// @param outer    Transformations of the enclosing elements, applied after the element's own
+    virtual void draw(PNGImage &img, const TransformChain &outer) const = 0;
+
+    /// @brief          Append the drawing commands of the element to a display list
+    /// @param out      Display list
+    /// @param outer    Transformations of the enclosing elements, applied after the element's own
+    virtual void compile(DisplayListWriter &out, const TransformChain &outer) const = 0;
+
+    /// @brief          Get the canvas pixels the element may draw on
+    /// @param outer    Transformations of the enclosing elements, applied after the element's own
+    /// @return         Bounding box after applying the transformations
+    virtual Box bounds(const TransformChain &outer) const = 0;
+
+    /// @brief          Get canvas pixels the element surely paints over, as all colors are opaque
+    /// @param outer    Transformations of the enclosing elements, applied after the element's own
+    /// @return         Box inside the drawn pixels, empty if none is known
+    virtual Box coverage(const TransformChain &outer) const = 0;
+
+    /// @brief  Recompute the cached bounds from the element's own geometry, and from the
+    ///         cached bounds of its children or referenced element
+    virtual void computeBounds() = 0;
+
+    /// @return Tag name of the element
+    virtual const char *tag() const = 0;
+
+    /// @return Points of the polylines and polygons the element draws, counted
+    ///         once per use drawing them
+    virtual size_t vertices() const = 0;
+
+    /// @brief          Get a box holding the canvas pixels the element may draw on, in
+    ///                 constant time from the cached bounds. It may be larger than bounds().
+    /// @param outer    Transformations of the enclosing elements, applied after the element's own
+    /// @return         Bounding box after applying the transformations
+    Box coarseBounds(const TransformChain &outer) const { return TransformChain(transform_, outer).bound(box_); }
 };
 
 class Ellipse : public SVGElement {
@@ -75,112 +91,182 @@ class Ellipse : public SVGElement {
 
   public:
     /// @brief          Ellipse Element
+    /// @param arena    Arena of the document
     /// @param id       Element's ID
-    /// @param t        Transformations
+    /// @param t        Transformation
     /// @param fill     Fill Color
     /// @param center   Ellipse Center
     /// @param radius   Point representing the x and y radius
     Ellipse(
-        const std::string &id, const std::vector<Transform> &t, const Color &fill, const Point &center,
+        Arena &arena, const std::string &id, const Transform &t, const Color &fill, const Point &center,
         const Point &radius
     );
 
-    void        draw(PNGImage &img) const override final;
-    SVGElement *copy(const std::vector<Transform> &t) const override final;
+    /// @param fill     New fill Color
+    void setColor(const Color &fill) { color_ = fill; }
+
+    void        draw(PNGImage &img, const TransformChain &outer) const override final;
+    void        compile(DisplayListWriter &out, const TransformChain &outer) const override final;
+    Box         bounds(const TransformChain &outer) const override final;
+    Box         coverage(const TransformChain &outer) const override final;
+    void        computeBounds() override final;
+    const char *tag() const override;
+    size_t      vertices() const override final;
 };
 
 class Circle : public Ellipse {
   public:
     /// @brief          Circle Element
+    /// @param arena    Arena of the document
     /// @param id       Element's ID
-    /// @param t        Transformations
+    /// @param t        Transformation
     /// @param fill     Fill Color
     /// @param center   Circle Center
     /// @param radius   Circle Radius
-    Circle(const std::string &id, const std::vector<Transform> &t, const Color &fill, const Point &center, int radius);
+    Circle(
+        Arena &arena, const std::string &id, const Transform &t, const Color &fill, const Point &center, int radius
+    );
+
+    const char *tag() const override final;
 };
 
 class PolyLine : public SVGElement {
   protected:
-    Color              color_;
-    std::vector<Point> points_;
+    Color     color_;
+    PointView points_;
+    size_t    capacity_; ///< Number of points the arena copy of points_ holds
 
   public:
     /// @brief          PolyLine Element
+    /// @param arena    Arena of the document
     /// @param id       Element's ID
-    /// @param t        Transformations
+    /// @param t        Transformation
     /// @param points   Points
     /// @param stroke   Stroke Color
     PolyLine(
-        const std::string &id, const std::vector<Transform> &t, const std::vector<Point> &points, const Color &stroke
+        Arena &arena, const std::string &id, const Transform &t, const PointArray &points, const Color &stroke
     );
 
-    void        draw(PNGImage &img) const override final;
-    SVGElement *copy(const std::vector<Transform> &t) const override final;
+    /// @param stroke   New stroke Color
+    void setColor(const Color &stroke) { color_ = stroke; }
+
+    /// @brief          Replace the points. They are written over the current copy
+    ///                 when they fit in it; otherwise they are copied to the arena,
+    ///                 and the old copy stays there until the document is cleared.
+    /// @param arena    Arena of the document
+    /// @param points   New points
+    void setPoints(Arena &arena, const PointArray &points);
+
+    void        draw(PNGImage &img, const TransformChain &outer) const override final;
+    void        compile(DisplayListWriter &out, const TransformChain &outer) const override final;
+    Box         bounds(const TransformChain &outer) const override final;
+    Box         coverage(const TransformChain &outer) const override final;
+    void        computeBounds() override final;
+    const char *tag() const override;
+    size_t      vertices() const override final;
 };
 
 class Line : public PolyLine {
   public:
     /// @brief          Line Element
+    /// @param arena    Arena of the document
     /// @param id       Element's ID
-    /// @param t        Transformations
+    /// @param t        Transformation
     /// @param point1   Start Point
     /// @param point2   End Point
     /// @param color    Stroke Color
     Line(
-        const std::string &id, const std::vector<Transform> &t, const Point &point1, const Point &point2,
+        Arena &arena, const std::string &id, const Transform &t, const Point &point1, const Point &point2,
         const Color &stroke
     );
+
+    const char *tag() const override final;
 };
 
 class PolyGon : public SVGElement {
   protected:
-    Color              color_;
-    std::vector<Point> points_;
+    Color     color_;
+    PointView points_;
+    size_t    capacity_; ///< Number of points the arena copy of points_ holds
 
   public:
     /// @brief          PolyGon
+    /// @param arena    Arena of the document
     /// @param id       Element's ID
-    /// @param t        Transformations
+    /// @param t        Transformation
     /// @param points   Points
     /// @param color    Fill Color
     PolyGon(
-        const std::string &id, const std::vector<Transform> &t, const std::vector<Point> &points, const Color &fill
+        Arena &arena, const std::string &id, const Transform &t, const PointArray &points, const Color &fill
     );
 
-    void        draw(PNGImage &img) const override final;
-    SVGElement *copy(const std::vector<Transform> &t) const override final;
+    /// @param fill     New fill Color
+    void setColor(const Color &fill) { color_ = fill; }
+
+    /// @brief          Replace the points. They are written over the current copy
+    ///                 when they fit in it; otherwise they are copied to the arena,
+    ///                 and the old copy stays there until the document is cleared.
+    /// @param arena    Arena of the document
+    /// @param points   New points
+    void setPoints(Arena &arena, const PointArray &points);
+
+    void        draw(PNGImage &img, const TransformChain &outer) const override final;
+    void        compile(DisplayListWriter &out, const TransformChain &outer) const override final;
+    Box         bounds(const TransformChain &outer) const override final;
+    Box         coverage(const TransformChain &outer) const override final;
+    void        computeBounds() override final;
+    const char *tag() const override;
+    size_t      vertices() const override final;
 };
 
 class Rectangle : public PolyGon {
   public:
     /// @brief          Rectangle Element
+    /// @param arena    Arena of the document
     /// @param id       Element's ID
-    /// @param t        Transformations
+    /// @param t        Transformation
     /// @param origin   Start Point
     /// @param width    Width
     /// @param height   Height
     /// @param color    Fill Color
     Rectangle(
-        const std::string &id, const std::vector<Transform> &t, const Color &fill, const Point &origin, int width,
+        Arena &arena, const std::string &id, const Transform &t, const Color &fill, const Point &origin, int width,
         int height
     );
+
+    const char *tag() const override final;
 };
 
 class GroupElement : public SVGElement {
   protected:
-    std::vector<SVGElement *> elems_;
+    SVGElement *const *elems_;
+    size_t             count_;
 
   public:
     /// @brief          Object that represents a group of elements
+    /// @param arena    Arena of the document
     /// @param id       Element's ID
-    /// @param t        Transformations
-    /// @param elems    Vector of Child Elements
-    GroupElement(const std::string &id, const std::vector<Transform> &t, const std::vector<SVGElement *> &elems);
-    ~GroupElement();
+    /// @param t        Transformation
+    /// @param elems    Child Elements, copied to the arena
+    /// @param count    Number of Child Elements
+    GroupElement(
+        Arena &arena, const std::string &id, const Transform &t, SVGElement *const *elems, size_t count
+    );
+
+    /// @return Number of children
+    size_t size() const { return count_; }
 
-    void        draw(PNGImage &img) const override final;
-    SVGElement *copy(const std::vector<Transform> &t) const override final;
+    /// @param i    Index of a child
+    /// @return     Child element
+    SVGElement *child(size_t i) const { return elems_[i]; }
+
+    void        draw(PNGImage &img, const TransformChain &outer) const override final;
+    void        compile(DisplayListWriter &out, const TransformChain &outer) const override final;
+    Box         bounds(const TransformChain &outer) const override final;
+    Box         coverage(const TransformChain &outer) const override final;
+    void        computeBounds() override final;
+    const char *tag() const override final;
+    size_t      vertices() const override final;
 };
 
 class UseElement : public SVGElement {
@@ -188,44 +274,395 @@ class UseElement : public SVGElement {
     const SVGElement *ref_;
 
   public:
-    /// @brief          Object with a reference to another element
+    /// @brief          Object with a reference to another element, which is drawn
+    ///                 with the extra transformations of the use, without copying it
+    /// @param arena    Arena of the document
     /// @param id       Element's ID
-    /// @param t        Transformations
-    /// @param ref      Pointer to third Element
-    UseElement(const std::string &id, const std::vector<Transform> &t, const SVGElement *ref);
-    ~UseElement();
+    /// @param t        Transformation
+    /// @param ref      Pointer to third Element (not owned), nullptr until it is resolved
+    UseElement(Arena &arena, const std::string &id, const Transform &t, const SVGElement *ref);
+
+    /// @return Referenced element, nullptr if not resolved
+    const SVGElement *ref() const { return ref_; }
+
+    /// @param ref  Referenced element, nullptr to draw nothing
+    void setRef(const SVGElement *ref) {
+        ref_ = ref;
+        computeBounds();
+    }
+
+    void        draw(PNGImage &img, const TransformChain &outer) const override final;
+    void        compile(DisplayListWriter &out, const TransformChain &outer) const override final;
+    Box         bounds(const TransformChain &outer) const override final;
+    Box         coverage(const TransformChain &outer) const override final;
+    void        computeBounds() override final;
+    const char *tag() const override final;
+    size_t      vertices() const override final;
+};
+
+/// @brief  Parsed svg file. Owns its elements, which are created in its arena
+///         and released all at once.
+class Document {
+  private:
+    Arena                                         arena_;
+    Point                                         dimensions_;
+    std::vector<SVGElement *>                     elements_;
+    std::unordered_map<std::string, SVGElement *> ids_; // Last element declared with each ID
+
+  public:
+    Document() : dimensions_{ 0, 0 } {}
+
+    /// @return Arena where the elements are created
+    Arena &arena() { return arena_; }
+
+    /// @return Image dimensions
+    Point dimensions() const { return dimensions_; }
+
+    /// @param dimensions   Image dimensions
+    void setDimensions(const Point &dimensions) { dimensions_ = dimensions; }
+
+    /// @return Top level elements, in drawing order
+    std::vector<SVGElement *> &elements() { return elements_; }
 
-    void        draw(PNGImage &img) const override final;
-    SVGElement *copy(const std::vector<Transform> &t) const override final;
+    /// @return Top level elements, in drawing order
+    const std::vector<SVGElement *> &elements() const { return elements_; }
+
+    /// @return Elements by ID
+    std::unordered_map<std::string, SVGElement *> &ids() { return ids_; }
+
+    /// @param id   Element's ID
+    /// @return     Last element declared with the ID, nullptr if there is none
+    SVGElement *find(const std::string &id) const;
+
+    /// @brief  Release all elements, keeping the arena memory to reuse it
+    void clear();
 };
 
+/// @brief              Recompute the cached bounds of elements and of everything they draw,
+///                     children and referenced elements first. Needed after a change of the
+///                     geometry or references, since the enclosing groups and uses cache it.
+/// @param elements     Elements
+void updateBounds(const std::vector<SVGElement *> &elements);
+
 /// @brief              Convert a svg file to a png file
 /// @param svg_file     Name of svg file
 /// @param png_file     Name of png file (will be overwritten!)
 void convert(const std::string &svg_file, const std::string &png_file);
 
+/// @brief              Options for the conversion of a svg file
+struct ConvertOptions {
+    /// @brief          Side of the square tiles rendered in parallel (0 renders serially)
+    int           tileSize;
+    /// @brief          Number of rendering threads (0 uses one per hardware thread)
+    unsigned      threads;
+    /// @brief          How element transformations are applied
+    TransformMode transformMode;
+    /// @brief          Skip the top level elements painted over by later ones, see cullOccluded()
+    bool          occlusionCulling;
+    /// @brief          Settings of the PNG encoder
+    PNGOptions    png;
+    /// @brief          Count elements, vertices, pixels and spans in RenderStats
+    bool          stats;
+    /// @brief          Count the writes to each pixel, and save them as a heat map next to the
+    ///                 png file, named as it with "_overdraw", see drawOverdraw()
+    bool          overdraw;
+    /// @brief          Pixel format of the image drawn and saved by Converter::convert. Formats
+    ///                 other than RGB888 are drawn from a display list compiled from the document,
+    ///                 whose replay is compiled for each format, after occlusion culling if asked.
+    ///                 Converter::render and Converter::renderPNG always draw RGB888.
+    PixelFormat   pixelFormat;
+
+    ConvertOptions()
+        : tileSize(0), threads(0), transformMode(TransformMode::Exact), occlusionCulling(false), stats(false),
+          overdraw(false), pixelFormat(PixelFormat::RGB888) {}
+};
 
-/// @brief              Read a SVG file and parse elements
-/// @param svg_file     Name of the file
-/// @param dimensions   Point to be filled with the image dimensions
-/// @param svg_elements Vector to be filled with read elements
-void readSVG(const std::string &svg_file, Point &dimensions, std::vector<SVGElement *> &svg_elements);
-
-
-/// @brief                  Parse XMLElement into an SVGElement and add it to svg_elements and possibly to svg_elems_id
-/// @param element          Pointer to the element
-/// @param svg_elements     List to add the element
-/// @param svg_elems_id     List of elements with ID
-/// @param transforms       List of inherited transformations
-void parseElement(
-    const tinyxml2::XMLElement *element, std::vector<SVGElement *> &elementList,
-    std::vector<SVGElement *> &elementListID, const std::vector<Transform> &transforms = {}
+/// @brief  Statistics of the last conversion of a Converter. Times are always measured;
+///         the counts only when ConvertOptions::stats is set.
+struct RenderStats {
+    /// @brief          Milliseconds reading and parsing the svg text
+    double                        parseMs;
+    /// @brief          Milliseconds culling and drawing the elements
+    double                        drawMs;
+    /// @brief          Milliseconds encoding the png file, and writing it if converting to a file
+    double                        encodeMs;
+    /// @brief          Elements of the document by tag name, each counted once
+    std::map<std::string, size_t> elements;
+    /// @brief          Points of the polylines and polygons drawn, once per use drawing them
+    size_t                        vertices;
+    /// @brief          Pixels written, counting overdraw, and spans filled, the same whether tiled or not
+    DrawCounters                  drawn;
+    /// @brief          Elements left out by occlusion culling
+    size_t                        culled;
+
+    RenderStats() : parseMs(0), drawMs(0), encodeMs(0), vertices(0), culled(0) {}
+
+    /// @return JSON object with the statistics, on one line
+    std::string json() const;
+};
+
+/// @brief              Convert a svg file to a png file
+/// @param svg_file     Name of svg file
+/// @param png_file     Name of png file (will be overwritten!)
+/// @param options      Conversion options
+void convert(const std::string &svg_file, const std::string &png_file, const ConvertOptions &options);
+
+/// @brief  Converts svg files to png files, keeping its document,
+///         image and display list buffers from one conversion to the next
+class Converter {
+  private:
+    ConvertOptions        options_;
+    Document              document_;
+    PNGImage              img_;
+    PNGImageRGBA          rgba_;  // Images of the other pixel formats
+    PNGImageGray          gray_;
+    std::vector<uint32_t> words_; // Display list being compiled
+
+    std::vector<SVGElement *> visible_; // Elements left by occlusion culling
+    RenderStats               stats_;   // Of the last conversion
+    std::vector<uint32_t>     writes_;  // Writes to each pixel, with ConvertOptions::overdraw
+
+    /// @brief              Start counting what is drawn on an image, as the options ask
+    /// @param img          Image
+    template <class Format> void startCounting(BasicPNGImage<Format> &img);
+
+    /// @brief              Draw the document read, which must have valid dimensions
+    /// @param name         Name of the source, for error messages
+    void draw(const std::string &name);
+
+    /// @brief              Encode an image to a png file
+    /// @param img          Image
+    /// @param png_file     Name of png file (will be overwritten!)
+    template <class Format> void save(const BasicPNGImage<Format> &img, const std::string &png_file);
+
+    /// @brief              Draw a display list on an image and save it
+    /// @param list         Display list
+    /// @param img          Image
+    /// @param name         Name of the source, for error messages
+    /// @param png_file     Name of png file (will be overwritten!)
+    template <class Format>
+    void renderList(
+        const DisplayList &list, BasicPNGImage<Format> &img, const std::string &name, const std::string &png_file
+    );
+
+    /// @brief              Draw a display list on the image of the pixel format of the options, and save it
+    /// @param list         Display list
+    /// @param name         Name of the source, for error messages
+    /// @param png_file     Name of png file (will be overwritten!)
+    void drawList(const DisplayList &list, const std::string &name, const std::string &png_file);
+
+    /// @brief              Render a display list file to a png file
+    /// @param dl_file      Name of display list file
+    /// @param png_file     Name of png file (will be overwritten!)
+    void renderDisplayList(const std::string &dl_file, const std::string &png_file);
+
+  public:
+    /// @param options  Conversion options
+    Converter(const ConvertOptions &options = ConvertOptions());
+
+    /// @brief              Convert a svg file to a png file. Files ending in .svgdl
+    ///                     are read as display lists, mapped in memory.
+    /// @param svg_file     Name of svg file
+    /// @param png_file     Name of png file (will be overwritten!)
+    void convert(const std::string &svg_file, const std::string &png_file);
+
+    /// @brief              Compile a svg file to a display list file, which renders
+    ///                     the same image without parsing or transforming
+    /// @param svg_file     Name of svg file
+    /// @param dl_file      Name of display list file (will be overwritten!)
+    void compile(const std::string &svg_file, const std::string &dl_file);
+
+    /// @brief              Render SVG text in memory, without touching the filesystem,
+    ///                     in RGB888 whatever ConvertOptions::pixelFormat asks
+    /// @param svg          SVG text, read in place
+    /// @param size         Size of the text
+    /// @return             Rendered image, whose rows hold packed RGB bytes; valid
+    ///                     until the next conversion
+    const PNGImage &render(const char *svg, size_t size);
+
+    /// @brief              Render SVG text in memory to PNG bytes, in RGB888 whatever
+    ///                     ConvertOptions::pixelFormat asks
+    /// @param svg          SVG text, read in place
+    /// @param size         Size of the text
+    /// @param png          Filled with the PNG file; its capacity is reused between calls
+    void renderPNG(const char *svg, size_t size, std::vector<unsigned char> &png);
+
+    /// @return Image of the last conversion in RGB888, or rendering
+    const PNGImage &image() const { return img_; }
+
+    /// @return Number of elements left out by occlusion culling in the last conversion
+    size_t culled() const { return stats_.culled; }
+
+    /// @return Statistics of the last conversion
+    const RenderStats &stats() const { return stats_; }
+
+    /// @return Writes to each pixel in the last conversion, row by row, with ConvertOptions::overdraw
+    const std::vector<uint32_t> &writes() const { return writes_; }
+};
+
+/// @brief              Draw a heat map of the writes to each pixel: black for none, then blue,
+///                     green, yellow and orange for 1 to 4, red for 5 to 7 and white for 8 or more
+/// @param writes       Writes to each pixel, row by row
+/// @param heat         Image to draw on, of the size of the canvas
+void drawOverdraw(const std::vector<uint32_t> &writes, PNGImage &heat);
+
+/// @brief              Draw elements splitting the canvas in tiles rendered in parallel
+/// @param elements     Elements to draw, in painter's order
+/// @param img          Image to draw on
+/// @param tileSize     Side of the square tiles
+/// @param threads      Number of rendering threads (0 uses one per hardware thread)
+/// @param mode         How to apply the transformations
+void drawTiled(
+    const std::vector<SVGElement *> &elements, PNGImage &img, int tileSize, unsigned threads, TransformMode mode
 );
 
+/// @brief              Leave out the elements whose pixels are all painted over by later ones,
+///                     which is sure since all colors are opaque. Elements are visited front to
+///                     back, marking the tiles of a coarse mask the visited ones cover; elements
+///                     whose bounds only reach covered tiles are left out.
+/// @param elements     Elements, in painter's order
+/// @param canvas       Canvas box
+/// @param mode         How to apply the transformations
+/// @param visible      Filled with the elements to draw, in painter's order
+/// @return             Number of elements left out
+size_t cullOccluded(
+    const std::vector<SVGElement *> &elements, const Box &canvas, TransformMode mode, std::vector<SVGElement *> &visible
+);
+
+
+/// @brief              Read a SVG file and parse elements as the tags are read, without
+///                     building a XML document. Only a small read buffer is kept.
+/// @param svg_file     Name of the file
+/// @param document     Document to be filled with the image dimensions and elements (cleared first)
+void readSVG(const std::string &svg_file, Document &document);
+
+/// @brief              Read SVG text from a stream and parse elements as the tags are read
+/// @param in           Stream with the SVG text
+/// @param name         Name of the source, for error messages
+/// @param document     Document to be filled with the image dimensions and elements (cleared first)
+void readSVG(std::istream &in, const std::string &name, Document &document);
+
+/// @brief              Read SVG text from memory and parse elements as the tags are read.
+///                     The text is not copied, only each tag while it is parsed.
+/// @param data         SVG text
+/// @param size         Size of the text, which need not be null terminated
+/// @param document     Document to be filled with the image dimensions and elements (cleared first)
+void readSVG(const char *data, size_t size, Document &document);
+
+/// @brief              Read a SVG file into a XML document and parse its elements
+/// @param doc          XML document to load the file into
+/// @param svg_file     Name of the file
+/// @param document     Document to be filled with the image dimensions and elements (cleared first)
+void readSVG(tinyxml2::XMLDocument &doc, const std::string &svg_file, Document &document);
+
+
+/// @brief  Attributes of the element being read. Names and values are not copied
+///         and must stay valid while the element is built.
+class Attributes {
+  private:
+    std::vector<std::pair<const char *, const char *>> list_;
+
+  public:
+    /// @brief  Remove all attributes
+    void clear() { list_.clear(); }
+
+    /// @param name     Attribute name
+    /// @param value    Attribute value
+    void add(const char *name, const char *value) { list_.push_back({ name, value }); }
+
+    /// @param name     Attribute name
+    /// @return         Attribute value, nullptr if the element does not have it
+    const char *get(const char *name) const;
+
+    /// @param name     Attribute name
+    /// @return         Attribute value as an integer, read as `istream >> int` does, so the
+    ///                 nearest int if it overflows; 0 if the element does not have it
+    int getInt(const char *name) const;
+};
+
+/// @brief  Elements with an ID, hashed by ID, and uses of IDs not seen yet
+struct IdIndex {
+    /// Last element declared with each ID
+    std::unordered_map<std::string, SVGElement *> elements;
+    /// Uses referencing an ID declared after them, with the ID
+    std::vector<std::pair<UseElement *, std::string>> pending;
+};
+
+/// @brief  Builds the elements of a document from the start and end of its tags,
+///         in document order. Used by the streaming reader and the XML document walk.
+class DocumentBuilder {
+  private:
+    /// @brief  Group whose end tag was not read yet
+    struct OpenGroup {
+        std::string id;
+        Transform   transform;
+        size_t      first; // Position of its first child in children_
+    };
+
+    Document                 &document_;
+    IdIndex                   index_;
+    std::vector<OpenGroup>    groups_;
+    std::vector<SVGElement *> children_; // Children of the open groups, innermost last
+    int                       depth_;    // Open tags
+    int                       skip_;     // Open tags inside an element that is not a group
+    PointArray                points_;   // Points of the last polyline or polygon, reused
+
+    /// @brief  Creates an element from its attributes, nullptr if it is not valid
+    typedef SVGElement *(DocumentBuilder::*Build)(const std::string &id, const Transform &t, const Attributes &a);
+
+    SVGElement *buildEllipse(const std::string &id, const Transform &t, const Attributes &a);
+    SVGElement *buildCircle(const std::string &id, const Transform &t, const Attributes &a);
+    SVGElement *buildPolyLine(const std::string &id, const Transform &t, const Attributes &a);
+    SVGElement *buildLine(const std::string &id, const Transform &t, const Attributes &a);
+    SVGElement *buildPolyGon(const std::string &id, const Transform &t, const Attributes &a);
+    SVGElement *buildRectangle(const std::string &id, const Transform &t, const Attributes &a);
+    SVGElement *buildUse(const std::string &id, const Transform &t, const Attributes &a);
+
+    /// @brief          Add an element to its group, or to the document
+    /// @param element  Element
+    /// @param id       Element's ID
+    void add(SVGElement *element, const std::string &id);
+
+  public:
+    /// @param document     Document to fill (cleared first)
+    explicit DocumentBuilder(Document &document);
+
+    /// @brief              Start of a tag. The first one is the <svg> root.
+    /// @param name         Tag name
+    /// @param attributes   Tag attributes
+    void start(const char *name, const Attributes &attributes);
+
+    /// @brief              End of the last tag started
+    void end();
+
+    /// @brief              End of the document, resolves the references to later elements
+    void finish();
+};
 
-/// @brief          Get Transformation from element atributes
-/// @param element  Pointer to Element
-/// @return         Transformation object
-Transform getTransform(const tinyxml2::XMLElement *element);
+/// @brief              Resolve the uses referencing elements declared after them, once the
+///                     whole document is parsed. Uses that would make a reference cycle, or
+///                     whose ID does not exist, draw nothing.
+/// @param index        Index of elements with ID
+/// @param elements     Top level elements of the document
+void resolveReferences(IdIndex &index, const std::vector<SVGElement *> &elements);
+
+
+/// @brief              Get Transformation from element atributes
+/// @param attributes   Element attributes
+/// @return             Transformation object
+Transform getTransform(const Attributes &attributes);
+
+/// @brief              Parse a transformation without allocating memory
+/// @param transform    Value of the transform attribute, "translate(x y)", "rotate(a)" or "scale(s)" (may be nullptr)
+/// @param origin       Value of the transform-origin attribute, "x y" (may be nullptr)
+/// @return             Transformation object
+Transform parseTransform(const char *transform, const char *origin);
+
+/// @brief              Parse a list of points "x1,y1 x2,y2 ...", separated by commas or white space,
+///                     up to the first value that is not an integer. Does not allocate memory if
+///                     points has enough capacity.
+/// @param str          Value of the points attribute (may be nullptr)
+/// @param points       Filled with the points
+void parsePoints(const char *str, PointArray &points);
 } // namespace svg
 #endif
\ No newline at end of file
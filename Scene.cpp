@@ -0,0 +1,112 @@
+#include "Scene.hpp"
+#include <stdexcept>
+#include <unordered_set>
+
+namespace svg {
+
+/// @brief          Record a top level element as drawing an element and everything it draws
+/// @param element  Element
+/// @param top      Index of the top level element
+/// @param seen     Elements already recorded for this top level element
+/// @param tops     Top level elements drawing each element
+static void recordTop(
+    const SVGElement *element, size_t top, std::unordered_set<const SVGElement *> &seen,
+    std::unordered_map<const SVGElement *, std::vector<size_t>> &tops
+) {
+    if (!seen.insert(element).second) return;
+    tops[element].push_back(top);
+    if (const GroupElement *group = dynamic_cast<const GroupElement *>(element)) {
+        for (size_t i = 0; i < group->size(); i++) recordTop(group->child(i), top, seen, tops);
+    } else if (const UseElement *use = dynamic_cast<const UseElement *>(element)) {
+        if (use->ref()) recordTop(use->ref(), top, seen, tops);
+    }
+}
+
+Scene::Scene(const std::string &svg_file, TransformMode mode) : mode_(mode), image_(1, 1) {
+    readSVG(svg_file, document_);
+    Point dimensions = document_.dimensions();
+    if (dimensions.x <= 0 || dimensions.y <= 0) { throw std::runtime_error(svg_file + ": invalid image dimensions"); }
+    image_.reset(dimensions.x, dimensions.y);
+
+    const std::vector<SVGElement *>       &elements = document_.elements();
+    TransformChain                         root(mode_);
+    std::unordered_set<const SVGElement *> seen;
+    for (size_t i = 0; i < elements.size(); i++) {
+        bounds_.push_back(elements[i]->bounds(root).intersect(image_.region()));
+        seen.clear();
+        recordTop(elements[i], i, seen, tops_);
+        elements[i]->draw(image_, root);
+    }
+}
+
+SVGElement *Scene::find(const std::string &id) const {
+    SVGElement *element = document_.find(id);
+    if (!element) throw std::invalid_argument("No element with ID " + id);
+    return element;
+}
+
+Box Scene::update(SVGElement *element, const std::function<void()> &change) {
+    auto found = tops_.find(element);
+    if (found == tops_.end()) { // Only referenced by uses that make cycles, never drawn
+        change();
+        return Box::empty();
+    }
+
+    const std::vector<SVGElement *> &elements = document_.elements();
+    TransformChain                   root(mode_);
+
+    // Old bounds, then new bounds, of the top level elements drawing the element
+    Box dirty = Box::empty();
+    for (size_t top : found->second) dirty = dirty.unite(bounds_[top]);
+    change();
+    std::vector<SVGElement *> changed;
+    for (size_t top : found->second) changed.push_back(elements[top]);
+    updateBounds(changed);
+    for (size_t top : found->second) {
+        bounds_[top] = elements[top]->bounds(root).intersect(image_.region());
+        dirty        = dirty.unite(bounds_[top]);
+    }
+
+    repaint(dirty);
+    return dirty;
+}
+
+void Scene::repaint(const Box &box) {
+    Box dirty = box.intersect(image_.region());
+    if (dirty.is_empty()) return;
+
+    // Redraw on a blank image of the box, in painter's order, and copy it back
+    const std::vector<SVGElement *> &elements = document_.elements();
+    TransformChain                   root(mode_);
+    PNGImage tile(dirty.min.x, dirty.min.y, dirty.max.x - dirty.min.x + 1, dirty.max.y - dirty.min.y + 1);
+    for (size_t i = 0; i < elements.size(); i++) {
+        if (bounds_[i].intersects(dirty)) elements[i]->draw(tile, root);
+    }
+    image_.paste(tile);
+}
+
+Box Scene::setColor(const std::string &id, const Color &c) {
+    SVGElement *element = find(id);
+    if (Ellipse *ellipse = dynamic_cast<Ellipse *>(element)) return update(element, [&]() { ellipse->setColor(c); });
+    if (PolyLine *line = dynamic_cast<PolyLine *>(element)) return update(element, [&]() { line->setColor(c); });
+    if (PolyGon *polygon = dynamic_cast<PolyGon *>(element)) return update(element, [&]() { polygon->setColor(c); });
+    throw std::invalid_argument("Element " + id + " has no color");
+}
+
+Box Scene::setPoints(const std::string &id, const PointArray &points) {
+    SVGElement *element = find(id);
+    Arena      &arena   = document_.arena();
+    if (PolyLine *line = dynamic_cast<PolyLine *>(element)) {
+        return update(element, [&]() { line->setPoints(arena, points); });
+    }
+    if (PolyGon *polygon = dynamic_cast<PolyGon *>(element)) {
+        return update(element, [&]() { polygon->setPoints(arena, points); });
+    }
+    throw std::invalid_argument("Element " + id + " has no points");
+}
+
+Box Scene::setTransform(const std::string &id, const Transform &t) {
+    SVGElement *element = find(id);
+    return update(element, [&]() { element->setTransform(t); });
+}
+} // namespace svg
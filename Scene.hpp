@@ -0,0 +1,80 @@
+/// @file Scene.hpp
+#ifndef __svg_Scene_hpp__
+#define __svg_Scene_hpp__
+
+#include "Color.hpp"
+#include "PNGImage.hpp"
+#include "Point.hpp"
+#include "SVGElements.hpp"
+#include "Transform.hpp"
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace svg {
+
+/// @brief  Parsed svg file kept in memory with its rendered image. Elements can be
+///         changed by ID, and each change repaints only the pixels it may affect:
+///         the union of the old and new bounds of the top level elements that draw
+///         the changed element, by redrawing the elements overlapping that box in order.
+class Scene {
+  private:
+    Document         document_;
+    TransformMode    mode_;
+    PNGImage         image_;
+    std::vector<Box> bounds_; // Of each top level element, clipped to the canvas
+
+    // Top level elements drawing each element, directly or through groups and uses
+    std::unordered_map<const SVGElement *, std::vector<size_t>> tops_;
+
+    /// @brief          Find an element
+    /// @param id       Element's ID
+    /// @return         Element
+    SVGElement *find(const std::string &id) const;
+
+    /// @brief          Change an element and repaint what it may have changed
+    /// @param element  Element
+    /// @param change   Change to apply to the element
+    /// @return         Repainted box
+    Box update(SVGElement *element, const std::function<void()> &change);
+
+  public:
+    /// @param svg_file     Name of svg file
+    /// @param mode         How to apply the transformations
+    explicit Scene(const std::string &svg_file, TransformMode mode = TransformMode::Exact);
+
+    /// @return Rendered image
+    const PNGImage &image() const { return image_; }
+
+    /// @return Parsed document, with the changes made
+    const Document &document() const { return document_; }
+
+    /// @brief          Change the fill or stroke color of an ellipse, circle, line, polyline,
+    ///                 polygon or rectangle
+    /// @param id       Element's ID
+    /// @param c        New color
+    /// @return         Repainted box
+    Box setColor(const std::string &id, const Color &c);
+
+    /// @brief          Change the points of a line, polyline, polygon or rectangle. The
+    ///                 element's arena copy of its points is reused when the new ones fit
+    ///                 in it, so the arena only grows when an element gets more points
+    ///                 than it ever had.
+    /// @param id       Element's ID
+    /// @param points   New points
+    /// @return         Repainted box
+    Box setPoints(const std::string &id, const PointArray &points);
+
+    /// @brief          Change the transformation of an element
+    /// @param id       Element's ID
+    /// @param t        New transformation
+    /// @return         Repainted box
+    Box setTransform(const std::string &id, const Transform &t);
+
+    /// @brief          Repaint a box of the canvas, drawing the elements that overlap it
+    /// @param box      Box to repaint
+    void repaint(const Box &box);
+};
+} // namespace svg
+#endif
@@ -0,0 +1,216 @@
+#include "Transform.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SVG_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace svg {
+namespace {
+/// @brief  Map applied by the batch kernels:
+///         u = (x + ax) * s, v = (y + ay) * s,
+///         x' = ox + round(m0 u + m1 v + m2), y' = oy + round(m3 u + m4 v + m5).
+///         Each form of a chain, and each Exact step, is one such map.
+struct LinearMap {
+    int    ax, ay;
+    double s;
+    double m[6];
+    int    ox, oy;
+};
+
+/// @brief          Apply a map to arrays of coordinates, one point at a time
+/// @param f        Map
+/// @param xs       X coordinates
+/// @param ys       Y coordinates
+/// @param n        Number of points
+/// @param out_x    Transformed X coordinates (may be xs)
+/// @param out_y    Transformed Y coordinates (may be ys)
+void map_scalar(const LinearMap &f, const int *xs, const int *ys, size_t n, int *out_x, int *out_y) {
+    for (size_t i = 0; i < n; i++) {
+        double u = (double)(xs[i] + f.ax) * f.s;
+        double v = (double)(ys[i] + f.ay) * f.s;
+        int    x = f.ox + (int)::lround(f.m[0] * u + f.m[1] * v + f.m[2]);
+        int    y = f.oy + (int)::lround(f.m[3] * u + f.m[4] * v + f.m[5]);
+        out_x[i] = x;
+        out_y[i] = y;
+    }
+}
+
+#ifdef SVG_X86_SIMD
+// Adding the largest double below 0.5, with the sign of the value, and
+// truncating rounds halfway cases away from zero, like lround.
+const double HALF_DOWN = 0.49999999999999994;
+
+/// @brief  SSE2 version of map_scalar(), 2 points at a time
+void map_sse2(const LinearMap &f, const int *xs, const int *ys, size_t n, int *out_x, int *out_y) {
+    const __m128i ax = _mm_set1_epi32(f.ax), ay = _mm_set1_epi32(f.ay);
+    const __m128i ox = _mm_set1_epi32(f.ox), oy = _mm_set1_epi32(f.oy);
+    const __m128d s = _mm_set1_pd(f.s), half = _mm_set1_pd(HALF_DOWN), sign = _mm_set1_pd(-0.0);
+    const __m128d m0 = _mm_set1_pd(f.m[0]), m1 = _mm_set1_pd(f.m[1]), m2 = _mm_set1_pd(f.m[2]);
+    const __m128d m3 = _mm_set1_pd(f.m[3]), m4 = _mm_set1_pd(f.m[4]), m5 = _mm_set1_pd(f.m[5]);
+    size_t        i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d u = _mm_mul_pd(_mm_cvtepi32_pd(_mm_add_epi32(_mm_loadl_epi64((const __m128i *)(xs + i)), ax)), s);
+        __m128d v = _mm_mul_pd(_mm_cvtepi32_pd(_mm_add_epi32(_mm_loadl_epi64((const __m128i *)(ys + i)), ay)), s);
+        __m128d x = _mm_add_pd(_mm_add_pd(_mm_mul_pd(m0, u), _mm_mul_pd(m1, v)), m2);
+        __m128d y = _mm_add_pd(_mm_add_pd(_mm_mul_pd(m3, u), _mm_mul_pd(m4, v)), m5);
+        x         = _mm_add_pd(x, _mm_or_pd(_mm_and_pd(x, sign), half));
+        y         = _mm_add_pd(y, _mm_or_pd(_mm_and_pd(y, sign), half));
+        _mm_storel_epi64((__m128i *)(out_x + i), _mm_add_epi32(_mm_cvttpd_epi32(x), ox));
+        _mm_storel_epi64((__m128i *)(out_y + i), _mm_add_epi32(_mm_cvttpd_epi32(y), oy));
+    }
+    map_scalar(f, xs + i, ys + i, n - i, out_x + i, out_y + i);
+}
+
+/// @brief  AVX2 version of map_scalar(), 4 points at a time
+__attribute__((target("avx2"))) void
+map_avx2(const LinearMap &f, const int *xs, const int *ys, size_t n, int *out_x, int *out_y) {
+    const __m128i ax = _mm_set1_epi32(f.ax), ay = _mm_set1_epi32(f.ay);
+    const __m128i ox = _mm_set1_epi32(f.ox), oy = _mm_set1_epi32(f.oy);
+    const __m256d s = _mm256_set1_pd(f.s), half = _mm256_set1_pd(HALF_DOWN), sign = _mm256_set1_pd(-0.0);
+    const __m256d m0 = _mm256_set1_pd(f.m[0]), m1 = _mm256_set1_pd(f.m[1]), m2 = _mm256_set1_pd(f.m[2]);
+    const __m256d m3 = _mm256_set1_pd(f.m[3]), m4 = _mm256_set1_pd(f.m[4]), m5 = _mm256_set1_pd(f.m[5]);
+    size_t        i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d u = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm_add_epi32(_mm_loadu_si128((const __m128i *)(xs + i)), ax)), s);
+        __m256d v = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm_add_epi32(_mm_loadu_si128((const __m128i *)(ys + i)), ay)), s);
+        __m256d x = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(m0, u), _mm256_mul_pd(m1, v)), m2);
+        __m256d y = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(m3, u), _mm256_mul_pd(m4, v)), m5);
+        x         = _mm256_add_pd(x, _mm256_or_pd(_mm256_and_pd(x, sign), half));
+        y         = _mm256_add_pd(y, _mm256_or_pd(_mm256_and_pd(y, sign), half));
+        _mm_storeu_si128((__m128i *)(out_x + i), _mm_add_epi32(_mm256_cvttpd_epi32(x), ox));
+        _mm_storeu_si128((__m128i *)(out_y + i), _mm_add_epi32(_mm256_cvttpd_epi32(y), oy));
+    }
+    map_scalar(f, xs + i, ys + i, n - i, out_x + i, out_y + i);
+}
+#endif
+
+typedef void (*MapKernel)(const LinearMap &, const int *, const int *, size_t, int *, int *);
+
+/// @brief  Pick the widest map kernel the CPU supports
+MapKernel select_map_kernel() {
+#ifdef SVG_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) return map_avx2;
+    return map_sse2;
+#else
+    return map_scalar;
+#endif
+}
+
+/// @brief  Apply a map to a sequence of points with the selected kernel
+void map_points(const LinearMap &f, const PointView &in, PointArray &out) {
+    static const MapKernel kernel = select_map_kernel();
+    out.resize(in.size());
+    if (in.size()) kernel(f, in.x, in.y, in.size(), out.x.data(), out.y.data());
+}
+} // namespace
+
+Transform::Transform(int tx, int ty, int r, int s, int ox, int oy)
+    : transX_(tx), transY_(ty), rotate_(r), scale_(s), origX_(ox), origY_(oy) {
+    // Same angle computation as Point::rotate, so rounding matches
+    double angle = M_PI * r / 180.0;
+    sin_         = ::sin(angle);
+    cos_         = ::cos(angle);
+}
+
+Point Transform::apply(const Point &p) const {
+    // Translate and Scale
+    double dx = (p.x + transX_ - origX_) * scale_;
+    double dy = (p.y + transY_ - origY_) * scale_;
+    if (rotate_ == 0) return Point{ origX_ + (int)dx, origY_ + (int)dy };
+
+    // Rotate
+    int rx = (int)::lround(cos_ * dx - sin_ * dy);
+    int ry = (int)::lround(sin_ * dx + cos_ * dy);
+    return Point{ origX_ + rx, origY_ + ry };
+}
+
+TransformChain::TransformChain(TransformMode mode)
+    : step_(nullptr), outer_(nullptr), mode_(mode), integral_(true), scale_(1), transX_(0), transY_(0),
+      matrix_{ 1, 0, 0, 0, 1, 0 }, error_(0) {}
+
+TransformChain::TransformChain(const Transform &t, const TransformChain &outer)
+    : step_(&t), outer_(&outer), mode_(outer.mode_), integral_(outer.integral_ && t.getRotate() == 0) {
+    int   s = t.getScale();
+    Point o = t.getOrigin();
+    Point d = t.getTrans();
+
+    // t is p -> o + s * (p + d - o) when it does not rotate
+    scale_  = outer.scale_ * s;
+    transX_ = outer.scale_ * (o.x + s * (d.x - o.x)) + outer.transX_;
+    transY_ = outer.scale_ * (o.y + s * (d.y - o.y)) + outer.transY_;
+
+    // t is p -> o + s * R (p + d - o) = L p + v with L = s * R and v = o + L (d - o)
+    double        cs   = t.getCos(), sn = t.getSin(); // Cached by the transformation
+    double        l[4] = { s * cs, -s * sn, s * sn, s * cs };
+    double        v[2] = {
+        o.x + l[0] * (d.x - o.x) + l[1] * (d.y - o.y),
+        o.y + l[2] * (d.x - o.x) + l[3] * (d.y - o.y),
+    };
+    const double *m    = outer.matrix_;
+    double        next[6] = {
+        m[0] * l[0] + m[1] * l[2], m[0] * l[1] + m[1] * l[3], m[0] * v[0] + m[1] * v[1] + m[2],
+        m[3] * l[0] + m[4] * l[2], m[3] * l[1] + m[4] * l[3], m[3] * v[0] + m[4] * v[1] + m[5],
+    };
+    for (int i = 0; i < 6; i++) matrix_[i] = next[i];
+
+    // A rotation rounds each coordinate by up to 1/2, which the outer steps scale
+    error_ = outer.error_ + (t.getRotate() == 0 ? 0 : 0.7072 * std::abs(outer.scale_));
+}
+
+Point TransformChain::apply(const Point &p) const {
+    if (mode_ == TransformMode::Fast) {
+        const double *m = matrix_;
+        return Point{ (int)::lround(m[0] * p.x + m[1] * p.y + m[2]), (int)::lround(m[3] * p.x + m[4] * p.y + m[5]) };
+    }
+
+    // Without rotations, integer steps compose without rounding
+    if (integral_) return Point{ scale_ * p.x + transX_, scale_ * p.y + transY_ };
+
+    Point q = p;
+    for (const TransformChain *c = this; c->step_; c = c->outer_) q = c->step_->apply(q);
+    return q;
+}
+
+Box TransformChain::bound(const Box &box) const {
+    if (box.is_empty()) return box;
+    const double *m     = matrix_;
+    double        xs[2] = { (double)box.min.x, (double)box.max.x };
+    double        ys[2] = { (double)box.min.y, (double)box.max.y };
+    double        x0 = HUGE_VAL, y0 = HUGE_VAL, x1 = -HUGE_VAL, y1 = -HUGE_VAL;
+    for (double x : xs) {
+        for (double y : ys) {
+            double u = m[0] * x + m[1] * y + m[2], v = m[3] * x + m[4] * y + m[5];
+            x0 = std::min(x0, u), x1 = std::max(x1, u);
+            y0 = std::min(y0, v), y1 = std::max(y1, v);
+        }
+    }
+    // One more pixel covers the rounding of the matrix itself
+    double pad = (mode_ == TransformMode::Fast ? 0.5 : error_) + 1;
+    return Box{ { (int)::floor(x0 - pad), (int)::floor(y0 - pad) }, { (int)::ceil(x1 + pad), (int)::ceil(y1 + pad) } };
+}
+
+void TransformChain::apply(const PointView &in, PointArray &out) const {
+    if (mode_ == TransformMode::Fast) {
+        const double *m = matrix_;
+        map_points({ 0, 0, 1, { m[0], m[1], m[2], m[3], m[4], m[5] }, 0, 0 }, in, out);
+    } else if (integral_) {
+        double s = scale_;
+        map_points({ 0, 0, 1, { s, 0, (double)transX_, 0, s, (double)transY_ }, 0, 0 }, in, out);
+    } else {
+        // Steps, in place after the first one (there is at least one rotation)
+        PointView src = in;
+        for (const TransformChain *c = this; c->step_; c = c->outer_) {
+            const Transform &step = *c->step_;
+            Point            o = step.getOrigin(), d = step.getTrans();
+            double           cs = step.getCos(), sn = step.getSin();
+            double           s = step.getScale();
+            map_points({ d.x - o.x, d.y - o.y, s, { cs, -sn, 0, sn, cs, 0 }, o.x, o.y }, src, out);
+            src = out;
+        }
+    }
+}
+} // namespace svg
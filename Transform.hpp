@@ -0,0 +1,111 @@
+/// @file Transform.hpp
+#ifndef __svg_Transform_hpp__
+#define __svg_Transform_hpp__
+
+#include "Point.hpp"
+
+namespace svg {
+
+class Transform {
+  private:
+    int    transX_, transY_;
+    int    rotate_;
+    int    scale_;
+    int    origX_, origY_;
+    double sin_, cos_; // Of the rotation angle
+
+  public:
+    /// @brief      Object that represents a transformation.
+    /// @param tx   Translation in X
+    /// @param ty   Translation in Y
+    /// @param r    Rotation
+    /// @param s    Scale
+    /// @param ox   Origin X
+    /// @param oy   Origin Y
+    Transform(int tx, int ty, int r, int s, int ox, int oy);
+
+    /// @return Translation
+    Point getTrans() const { return Point{ transX_, transY_ }; }
+
+    /// @return Rotation
+    int getRotate() const { return rotate_; }
+
+    /// @return Scale
+    int getScale() const { return scale_; }
+
+    /// @return Origin
+    Point getOrigin() const { return Point{ origX_, origY_ }; }
+
+    /// @brief          Translate, scale and rotate a point, rounding the rotation
+    ///                 like Point::rotate but without recomputing sin and cos
+    /// @param p        Point
+    /// @return         Transformed point
+    Point apply(const Point &p) const;
+
+    /// @return Sine of the rotation angle
+    double getSin() const { return sin_; }
+
+    /// @return Cosine of the rotation angle
+    double getCos() const { return cos_; }
+};
+
+/// @brief  How a chain of transformations is applied to points
+enum class TransformMode {
+    Exact, ///< Round after each rotation, like applying the transformations one by one
+    Fast   ///< Apply the composed affine matrix and round once
+};
+
+/// @brief  Chain of transformations of an element and its enclosing elements, built
+///         while drawing. Each link adds one transformation in front of an outer
+///         chain and composes with it in constant time, so the cost of deep groups
+///         is paid once per element instead of once per point.
+class TransformChain {
+  private:
+    const Transform      *step_;     // First transformation applied (nullptr in the empty chain)
+    const TransformChain *outer_;    // Transformations applied after step_
+    TransformMode         mode_;
+    bool                  integral_; // No step rotates, so the Exact mode is the integer map s * p + t
+    int                   scale_;    // Product of the scales
+    int                   transX_, transY_;
+    double                matrix_[6]; // x' = m0 x + m1 y + m2, y' = m3 x + m4 y + m5
+    double                error_;     // Bound of the distance from Exact points to the matrix points
+
+  public:
+    /// @brief          Empty chain, the outermost one
+    /// @param mode     How the chains built on it are applied
+    explicit TransformChain(TransformMode mode = TransformMode::Exact);
+
+    /// @brief          Chain applying a transformation and then an outer chain.
+    ///                 Both must outlive the new chain.
+    /// @param t        Transformation
+    /// @param outer    Chain applied after t
+    TransformChain(const Transform &t, const TransformChain &outer);
+
+    /// @return How the chain is applied
+    TransformMode mode() const { return mode_; }
+
+    /// @brief          Apply the chain to a point
+    /// @param p        Point
+    /// @return         Transformed point
+    Point apply(const Point &p) const;
+
+    /// @brief          Apply the chain to a sequence of points at once, with SIMD
+    ///                 instructions if the CPU has them. Points match the ones
+    ///                 given by the single point version.
+    /// @param in       Points
+    /// @param out      Filled with the transformed points (may be the same as in)
+    void apply(const PointView &in, PointArray &out) const;
+
+    /// @brief          Scale a radius, which is independent from the origin and rotation
+    /// @param r        Radius in X and Y
+    /// @return         Scaled radius
+    Point scaleRadius(const Point &r) const { return Point{ r.x * scale_, r.y * scale_ }; }
+
+    /// @brief          Box holding the transformed points of a box in either mode,
+    ///                 from its corners through the matrix and a bound of the rounding
+    /// @param box      Box
+    /// @return         Transformed box, empty if box is
+    Box bound(const Box &box) const;
+};
+} // namespace svg
+#endif
@@ -0,0 +1,855 @@
+// Project file headers
+#include "DisplayList.hpp"
+#include "PNGImage.hpp"
+#include "SVGElements.hpp"
+#include "Scene.hpp"
+#include "Transform.hpp"
+#include "reference.hpp"
+
+// C++ library headers
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// POSIX headers
+#include <dirent.h>
+
+namespace svg {
+// Average time in nanoseconds of a function, repeated for at least min_ms.
+double time_ns(const function<void()> &f, int min_ms = 200) {
+    typedef chrono::steady_clock clock;
+    int                          runs = 0;
+    clock::time_point            start = clock::now();
+    clock::duration              elapsed;
+    do {
+        f();
+        runs++;
+        elapsed = clock::now() - start;
+    } while (elapsed < chrono::milliseconds(min_ms));
+    return (double)chrono::duration_cast<chrono::nanoseconds>(elapsed).count() / runs;
+}
+
+void bench_draw_polygon() {
+    const Color color = { 0, 0, 255 };
+    cout << "# draw_polygon: active edge table vs per-row edge walk" << endl
+         << "vertices,ns,reference_ns,speedup" << endl;
+    for (int n : { 4, 16, 64, 256, 1024, 4096 }) {
+        vector<Point> points = star(n, { 512, 512 }, 500, 300);
+        PNGImage      img(1024, 1024), ref(1024, 1024);
+        double        ns     = time_ns([&]() { img.draw_polygon(points, color); });
+        double        ref_ns = time_ns([&]() { reference_draw_polygon(ref, points, color); });
+        cout << n << ',' << fixed << setprecision(0) << ns << ',' << ref_ns << ',' << setprecision(2)
+             << ref_ns / ns << endl;
+    }
+}
+
+void bench_fill_span() {
+    const Color color = { 255, 0, 0 };
+    cout << "# fill_span: span fill vs horizontal draw_line" << endl
+         << "length,ns_per_pixel,draw_line_ns_per_pixel" << endl;
+    PNGImage img(4096, 64);
+    for (int n : { 8, 64, 512, 4096 }) {
+        double ns      = time_ns([&]() {
+            for (int y = 0; y < 64; y++) img.fill_span(y, 0, n - 1, color);
+        });
+        double line_ns = time_ns([&]() {
+            for (int y = 0; y < 64; y++) img.draw_line({ 0, y }, { n - 1, y }, color);
+        });
+        cout << n << ',' << fixed << setprecision(3) << ns / (64.0 * n) << ',' << line_ns / (64.0 * n) << endl;
+    }
+}
+
+void bench_transform_chain() {
+    cout << "# transform chain: per point Point methods vs composed chain" << endl
+         << "depth,point_methods_ns_per_vertex,exact_ns_per_vertex,fast_ns_per_vertex" << endl;
+    vector<Point> points = star(10000, { 512, 512 }, 500, 300), out(points.size());
+    for (int depth : { 1, 4, 16 }) {
+        vector<Transform> t;
+        for (int i = 0; i < depth; i++) t.push_back(Transform(i, -i, i % 4 ? 0 : 15, 1, 512, 512));
+        vector<TransformChain> links = chain_links(t, TransformMode::Exact);
+        vector<TransformChain> fast_links = chain_links(t, TransformMode::Fast);
+        const TransformChain  &chain = links.back(), &fast_chain = fast_links.back();
+        double         methods_ns = time_ns([&]() {
+            for (size_t i = 0; i < points.size(); i++) {
+                Point p = points[i];
+                for (const Transform &step : t) {
+                    p = p.translate(step.getTrans());
+                    p = p.scale(step.getOrigin(), step.getScale());
+                    p = p.rotate(step.getOrigin(), step.getRotate());
+                }
+                out[i] = p;
+            }
+        });
+        double         exact_ns   = time_ns([&]() {
+            for (size_t i = 0; i < points.size(); i++) out[i] = chain.apply(points[i]);
+        });
+        double         fast_ns    = time_ns([&]() {
+            for (size_t i = 0; i < points.size(); i++) out[i] = fast_chain.apply(points[i]);
+        });
+        double n = points.size();
+        cout << depth << ',' << fixed << setprecision(2) << methods_ns / n << ',' << exact_ns / n << ',' << fast_ns / n
+             << endl;
+    }
+}
+
+void bench_transform_batch() {
+    cout << "# transform batch: per point chain vs SoA batch kernel" << endl
+         << "mode,vertices,per_point_ns_per_vertex,batch_ns_per_vertex" << endl;
+    vector<Transform> t = { Transform(3, -7, 30, 2, 100, 50), Transform(0, 0, 0, 3, -20, 10),
+                            Transform(11, 5, -45, 1, 0, 0) };
+    for (TransformMode mode : { TransformMode::Exact, TransformMode::Fast }) {
+        vector<TransformChain> links = chain_links(t, mode);
+        const TransformChain  &chain = links.back();
+        for (int n : { 100, 50000 }) {
+            PointArray in, out;
+            for (int i = 0; i < n; i++) {
+                in.x.push_back(rand() % 20001 - 10000);
+                in.y.push_back(rand() % 20001 - 10000);
+            }
+            vector<Point> single(n);
+            double        point_ns = time_ns([&]() {
+                for (int i = 0; i < n; i++) single[i] = chain.apply(in.at(i));
+            });
+            double        batch_ns = time_ns([&]() { chain.apply(in, out); });
+            cout << (mode == TransformMode::Exact ? "exact," : "fast,") << n << ',' << fixed << setprecision(2)
+                 << point_ns / n << ',' << batch_ns / n << endl;
+        }
+    }
+}
+// Node as it was allocated before the document arena: own id string, own
+// point arrays and owned children, each one a separate heap allocation.
+struct HeapNode {
+    string                       id;
+    PointArray                   points;
+    vector<unique_ptr<HeapNode>> children;
+};
+
+void bench_document() {
+    cout << "# document: build and release a tree of groups of polylines, heap nodes vs arena" << endl
+         << "nodes,heap_ns_per_node,arena_ns_per_node" << endl;
+    const Transform  t(0, 0, 0, 1, 0, 0);
+    const PointArray points(star(8, { 50, 50 }, 40, 20));
+    for (int groups : { 10, 1000 }) {
+        const int nodes   = groups * 101;
+        double    heap_ns = time_ns([&]() {
+            vector<unique_ptr<HeapNode>> top;
+            for (int g = 0; g < groups; g++) {
+                unique_ptr<HeapNode> group(new HeapNode{ "group" + to_string(g), PointArray(), {} });
+                for (int i = 0; i < 100; i++)
+                    group->children.emplace_back(new HeapNode{ "line" + to_string(i), points, {} });
+                top.push_back(move(group));
+            }
+        });
+        Document document;
+        double   arena_ns = time_ns([&]() {
+            Arena               &arena = document.arena();
+            vector<SVGElement *> children;
+            for (int g = 0; g < groups; g++) {
+                children.clear();
+                for (int i = 0; i < 100; i++) {
+                    children.push_back(arena.create<PolyLine>(arena, "line" + to_string(i), t, points, Color{}));
+                }
+                document.elements().push_back(
+                    arena.create<GroupElement>(arena, "group" + to_string(g), t, children.data(), children.size())
+                );
+            }
+            document.clear();
+        });
+        cout << nodes << ',' << fixed << setprecision(2) << heap_ns / nodes << ',' << arena_ns / nodes << endl;
+    }
+}
+
+void bench_use_resolution() {
+    cout << "# use resolution: parse documents with n ids and n uses, half of them forward references" << endl
+         << "ids,ns_per_element" << endl;
+    const string file = "bench_uses.svg";
+    for (int n : { 1000, 20000 }) {
+        ofstream out(file);
+        out << "<svg width=\"100\" height=\"100\">" << endl;
+        for (int i = 0; i < n; i++) {
+            out << "<use href=\"#s" << (i + n / 2) % n << "\"/>" << endl
+                << "<circle id=\"s" << i << "\" cx=\"50\" cy=\"50\" r=\"10\" fill=\"red\"/>" << endl;
+        }
+        out << "</svg>" << endl;
+        out.close();
+
+        Document document;
+        double   ns = time_ns([&]() { readSVG(file, document); });
+        cout << n << ',' << fixed << setprecision(2) << ns / (2 * n) << endl;
+    }
+    remove(file.c_str());
+}
+
+void bench_read() {
+    cout << "# read: XML document walk vs streaming tag reader, from the file and from memory" << endl
+         << "elements,dom_ns_per_element,stream_ns_per_element,memory_ns_per_element" << endl;
+    const string file = "bench_read.svg";
+    for (int n : { 100, 20000 }) {
+        ofstream out(file);
+        out << "<?xml version=\"1.0\"?>" << endl << "<svg width=\"500\" height=\"500\">" << endl;
+        for (int i = 0; i < n; i++) {
+            if (i % 100 == 0) out << (i ? "</g>\n" : "") << "<g transform=\"translate(" << i % 7 << " 3)\">" << endl;
+            out << "<!-- polygon " << i << " --><polygon fill=\"#FADFAA\" points=\"";
+            for (const Point &p : star(16, { 250, 250 }, 200, 100 + i % 50)) out << p.x << ',' << p.y << ' ';
+            out << "\"/>" << endl;
+        }
+        out << "</g>" << endl << "</svg>" << endl;
+        out.close();
+
+        ifstream in(file, ios::binary);
+        string   text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+        tinyxml2::XMLDocument xml;
+        Document              dom_document, stream_document, memory_document;
+        double                dom_ns    = time_ns([&]() { readSVG(xml, file, dom_document); });
+        double                stream_ns = time_ns([&]() { readSVG(file, stream_document); });
+        double                memory_ns = time_ns([&]() { readSVG(text.data(), text.size(), memory_document); });
+        cout << n << ',' << fixed << setprecision(2) << dom_ns / n << ',' << stream_ns / n << ',' << memory_ns / n
+             << endl;
+    }
+    remove(file.c_str());
+}
+
+void bench_parsers() {
+    cout << "# parsers: string stream parsing vs non-allocating parsers" << endl
+         << "parser,input,stream_ns,parser_ns" << endl;
+
+    // Points
+    for (int n : { 16, 4096 }) {
+        string str;
+        for (const Point &p : star(n, { 5000, 5000 }, 4000, 2000))
+            str += to_string(p.x) + (n % 3 ? "," : " ") + to_string(p.y) + " ";
+        vector<Point> expected;
+        PointArray    points;
+        double        stream_ns = time_ns([&]() {
+            expected.clear();
+            reference_parse_points(str.c_str(), expected);
+        });
+        double        parser_ns = time_ns([&]() { parsePoints(str.c_str(), points); });
+        cout << "points," << n << " vertices," << fixed << setprecision(2) << stream_ns << ',' << parser_ns << endl;
+    }
+
+    // Transformations
+    for (const char *str : { "translate(-120, 45)", "rotate(30)", "scale(3)" }) {
+        Transform expected = reference_parse_transform(str), parsed = parseTransform(str, nullptr);
+        double    stream_ns = time_ns([&]() { expected = reference_parse_transform(str); });
+        double    parser_ns = time_ns([&]() { parsed = parseTransform(str, nullptr); });
+        cout << "transform," << str << ',' << stream_ns << ',' << parser_ns << endl;
+    }
+
+    // Colors
+    for (const char *str : { "#FADFAA", "white" }) {
+        Color  expected = reference_parse_color(str), parsed = parse_color(str);
+        double stream_ns = time_ns([&]() { expected = reference_parse_color(str); });
+        double parser_ns = time_ns([&]() { parsed = parse_color(str); });
+        cout << "color," << str << ',' << stream_ns << ',' << parser_ns << endl;
+    }
+}
+void bench_display_list() {
+    cout << "# display list: parse and draw the svg file vs render its compiled display list" << endl
+         << "file,svg_us,display_list_us,display_list_bytes" << endl;
+    for (const char *file : { "input/lion.svg", "input/group_7.svg" }) {
+        Document document;
+        readSVG(file, document);
+        Point    size = document.dimensions();
+        PNGImage svg_img(size.x, size.y), dl_img(size.x, size.y);
+
+        double svg_ns = time_ns([&]() {
+            readSVG(file, document);
+            svg_img.reset(size.x, size.y);
+            for (SVGElement *e : document.elements()) e->draw(svg_img, TransformChain());
+        });
+
+        vector<uint32_t> words;
+        compileDisplayList(document, words, TransformMode::Exact);
+        double dl_ns = time_ns([&]() {
+            dl_img.reset(size.x, size.y);
+            DisplayList(words.data(), words.size() * sizeof(uint32_t)).render(dl_img);
+        });
+        cout << file << ',' << fixed << setprecision(2) << svg_ns / 1000 << ',' << dl_ns / 1000 << ','
+             << words.size() * sizeof(uint32_t) << endl;
+    }
+}
+
+// Fill, display list render and PNG encode times of a pixel format
+template <class Format> void pixel_format_row(const char *name, const vector<uint32_t> &words) {
+    const Color           color = { 255, 0, 0 };
+    const DisplayList     list(words.data(), words.size() * sizeof(uint32_t));
+    const int             w = list.width(), h = list.height();
+    BasicPNGImage<Format> img(w, h);
+    double                fill_ns   = time_ns([&]() {
+        for (int y = 0; y < h; y++) img.fill_span(y, 0, w - 1, color);
+    });
+    double                render_ns = time_ns([&]() {
+        img.reset(w, h);
+        list.render(img);
+    });
+    vector<unsigned char> png;
+    PNGOptions            options;
+    options.threads  = 1;
+    double encode_ns = time_ns([&]() { encode_png(img, options, png); });
+    cout << name << ',' << sizeof(typename Format::Pixel) << ',' << fixed << setprecision(3)
+         << fill_ns / ((double)w * h) << ',' << setprecision(2) << render_ns / 1000 << ',' << encode_ns / 1000 << ','
+         << png.size() << endl;
+}
+
+void bench_pixel_formats() {
+    cout << "# pixel formats: full row fills, display list render and png encode (1 thread) of the lion" << endl
+         << "format,bytes_per_pixel,fill_ns_per_pixel,render_us,encode_us,png_bytes" << endl;
+    Document document;
+    readSVG("input/lion.svg", document);
+    vector<uint32_t> words;
+    compileDisplayList(document, words, TransformMode::Exact);
+    pixel_format_row<RGB888>("rgb888", words);
+    pixel_format_row<RGBA8888>("rgba8888", words);
+    pixel_format_row<Gray8>("gray8", words);
+}
+
+void bench_scene() {
+    cout << "# scene: change one element and repaint its box vs redraw the whole canvas" << endl
+         << "elements,change,full_redraw_us,update_us" << endl;
+    const string file = "bench_scene.svg";
+    for (int n : { 100, 200 }) {
+        // n x n grid of squares on a 10n x 10n canvas
+        ofstream out(file);
+        out << "<svg width=\"" << 10 * n << "\" height=\"" << 10 * n << "\">" << endl;
+        for (int i = 0; i < n * n; i++) {
+            out << "<rect id=\"r" << i << "\" x=\"" << i % n * 10 << "\" y=\"" << i / n * 10
+                << "\" width=\"12\" height=\"12\" fill=\"" << (i % 2 ? "red" : "blue") << "\"/>" << endl;
+        }
+        out << "</svg>" << endl;
+        out.close();
+
+        Scene    scene(file);
+        PNGImage full(10 * n, 10 * n);
+        double   full_ns = time_ns([&]() {
+            full.reset(10 * n, 10 * n);
+            for (SVGElement *e : scene.document().elements()) e->draw(full, TransformChain());
+        });
+
+        const string id       = "r" + to_string(n * n / 2 + n / 2);
+        int          toggle   = 0;
+        double       color_ns = time_ns([&]() { scene.setColor(id, ++toggle % 2 ? Color{ 0, 255, 0 } : Color{}); });
+        double       move_ns  = time_ns([&]() {
+            scene.setTransform(id, Transform(++toggle % 2 ? 15 : 0, 5, 0, 1, 0, 0));
+        });
+        cout << n * n << ",color," << fixed << setprecision(2) << full_ns / 1000 << ',' << color_ns / 1000 << endl
+             << n * n << ",transform," << full_ns / 1000 << ',' << move_ns / 1000 << endl;
+    }
+    remove(file.c_str());
+}
+
+void bench_culling() {
+    cout << "# culling: draw a zoomed crop of a large document, walking every element vs skipping" << endl
+         << "# subtrees outside the canvas, and long lines walked whole vs clipped" << endl
+         << "case,elements,reference_us,culled_us" << endl;
+    const string file = "bench_culling.svg";
+    for (int n : { 50, 100 }) {
+        // n x n cells of 4 shapes, zoomed 8 times on a 256 x 256 canvas: about 1/100 is visible
+        ofstream out(file);
+        out << "<svg width=\"256\" height=\"256\"><g transform=\"scale(8)\">" << endl;
+        for (int i = 0; i < n * n; i++) {
+            int x = i % n * 10, y = i / n * 10;
+            out << "<g><rect x=\"" << x << "\" y=\"" << y << "\" width=\"6\" height=\"6\" fill=\"red\"/>"
+                << "<circle cx=\"" << x + 5 << "\" cy=\"" << y + 5 << "\" r=\"3\" fill=\"blue\"/>"
+                << "<line x1=\"" << x << "\" y1=\"" << y << "\" x2=\"" << x + 9 << "\" y2=\"" << y + 7
+                << "\" stroke=\"black\"/><polygon points=\"" << x << ',' << y + 9 << ' ' << x + 9 << ',' << y + 9
+                << ' ' << x + 4 << ',' << y + 5 << "\" fill=\"green\"/></g>" << endl;
+        }
+        out << "</g></svg>" << endl;
+        out.close();
+
+        Document document;
+        readSVG(file, document);
+        const GroupElement *zoomed = dynamic_cast<const GroupElement *>(document.elements()[0]);
+        Transform           zoom(0, 0, 0, 8, 0, 0), none(0, 0, 0, 1, 0, 0);
+        TransformChain      root, chain(zoom, root), cell(none, chain);
+        PNGImage            reference(256, 256), culled(256, 256);
+
+        double reference_ns = time_ns([&]() {
+            reference.reset(256, 256);
+            for (size_t i = 0; i < zoomed->size(); i++) {
+                const GroupElement *group = dynamic_cast<const GroupElement *>(zoomed->child(i));
+                for (size_t j = 0; j < group->size(); j++) group->child(j)->draw(reference, cell);
+            }
+        });
+        double culled_ns = time_ns([&]() {
+            culled.reset(256, 256);
+            for (SVGElement *e : document.elements()) e->draw(culled, root);
+        });
+        cout << "crop," << 4 * n * n << ',' << fixed << setprecision(2) << reference_ns / 1000 << ','
+             << culled_ns / 1000 << endl;
+    }
+    remove(file.c_str());
+
+    // Lines through the canvas from far outside of it
+    vector<pair<Point, Point>> lines;
+    for (int i = 0; i < 100; i++) {
+        lines.push_back({ { -100000 + i * 37, -80000 + i * 11 }, { 100000 - i * 29, 90000 - i * 13 } });
+    }
+    PNGImage reference(256, 256), clipped(256, 256);
+    double   reference_ns = time_ns([&]() {
+        for (const auto &l : lines) reference_draw_line(reference, l.first, l.second, Color{ 0, 0, 255 });
+    });
+    double   clipped_ns   = time_ns([&]() {
+        for (const auto &l : lines) clipped.draw_line(l.first, l.second, Color{ 0, 0, 255 });
+    });
+    cout << "long_lines," << lines.size() << ',' << reference_ns / 1000 << ',' << clipped_ns / 1000 << endl;
+}
+
+void bench_occlusion() {
+    cout << "# occlusion: draw every layer of a layered map vs cull the elements painted over first" << endl
+         << "layers,elements,culled,draw_us,cull_and_draw_us" << endl;
+    const string file = "bench_occlusion.svg";
+    for (int layers : { 5, 10 }) {
+        // Each layer is an opaque background tile with 2000 shapes over it
+        ofstream out(file);
+        out << "<svg width=\"512\" height=\"512\">" << endl;
+        for (int l = 0; l < layers; l++) {
+            out << "<g><rect x=\"0\" y=\"0\" width=\"512\" height=\"512\" fill=\"" << (l % 2 ? "white" : "yellow")
+                << "\"/>" << endl;
+            for (int i = 0; i < 1000; i++) {
+                int x = i * 37 % 500, y = i * 53 % 500;
+                out << "<circle cx=\"" << x << "\" cy=\"" << y << "\" r=\"12\" fill=\"blue\"/>"
+                    << "<polyline points=\"" << x << ',' << y << ' ' << x + 30 << ',' << y + 10 << ' ' << x + 5 << ','
+                    << y + 40 << "\" stroke=\"black\"/>" << endl;
+            }
+            out << "</g>" << endl;
+        }
+        out << "</svg>" << endl;
+        out.close();
+
+        Document document;
+        readSVG(file, document);
+        PNGImage             all(512, 512), culled(512, 512);
+        vector<SVGElement *> visible;
+        size_t               count   = 0;
+        double               draw_ns = time_ns([&]() {
+            all.reset(512, 512);
+            for (SVGElement *e : document.elements()) e->draw(all, TransformChain());
+        });
+        double               cull_ns = time_ns([&]() {
+            culled.reset(512, 512);
+            count = cullOccluded(document.elements(), culled.region(), TransformMode::Exact, visible);
+            for (SVGElement *e : visible) e->draw(culled, TransformChain());
+        });
+        cout << layers << ',' << layers * 2001 << ',' << count << ',' << fixed << setprecision(2) << draw_ns / 1000
+             << ',' << cull_ns / 1000 << endl;
+    }
+    remove(file.c_str());
+}
+
+void bench_png_encode() {
+    cout << "# png encode: stb_image_write vs banded encoder, by level, filter and threads" << endl
+         << "encoder,level,filter,threads,ms,bytes" << endl;
+    // The lion tiled 4 x 4 on a 2000 x 2000 canvas
+    Document document;
+    readSVG("input/lion.svg", document);
+    PNGImage       img(2000, 2000);
+    TransformChain root;
+    for (int i = 0; i < 16; i++) {
+        Transform      t(i % 4 * 500, i / 4 * 500, 0, 1, 0, 0);
+        TransformChain chain(t, root);
+        for (SVGElement *e : document.elements()) e->draw(img, chain);
+    }
+
+    const string file     = "bench_encode.png";
+    auto         size     = [&]() {
+        ifstream in(file, ios::binary | ios::ate);
+        return (long)in.tellg();
+    };
+    double       stb_ns   = time_ns([&]() { img.save(file); });
+    cout << "stb,-,-,1," << fixed << setprecision(2) << stb_ns / 1e6 << ',' << size() << endl;
+
+    const char      *filters[] = { "none", "sub", "up", "average", "paeth", "adaptive" };
+    vector<unsigned> thread_counts = { 1 };
+    if (thread::hardware_concurrency() > 1) thread_counts.push_back(thread::hardware_concurrency());
+    for (int level : { 0, 1, 6, 9 }) {
+        for (PNGFilter filter : { PNGFilter::None, PNGFilter::Up, PNGFilter::Adaptive }) {
+            for (unsigned threads : thread_counts) {
+                PNGOptions options;
+                options.level   = level;
+                options.filter  = filter;
+                options.threads = threads;
+                double ns       = time_ns([&]() { img.save(file, options); });
+                cout << "banded," << level << ',' << filters[(int)filter] << ',' << threads << ',' << ns / 1e6 << ','
+                     << size() << endl;
+            }
+        }
+    }
+    remove(file.c_str());
+}
+
+void bench_render_memory() {
+    cout << "# render memory: svg text to png bytes through temporary files vs in memory" << endl
+         << "file,files_ms,memory_ms" << endl;
+    for (const string name : { "lion", "batman_2" }) {
+        ifstream in("input/" + name + ".svg", ios::binary);
+        string   text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+        // What a service using the file API does for each request
+        const string          svg_file = "bench_render.svg", png_file = "bench_render.png";
+        Converter             converter;
+        vector<unsigned char> file_png, memory_png;
+        double                files_ns = time_ns([&]() {
+            ofstream(svg_file, ios::binary).write(text.data(), text.size());
+            converter.convert(svg_file, png_file);
+            ifstream png(png_file, ios::binary);
+            file_png.assign(istreambuf_iterator<char>(png), istreambuf_iterator<char>());
+        });
+        double memory_ns = time_ns([&]() { converter.renderPNG(text.data(), text.size(), memory_png); });
+        cout << name << ',' << fixed << setprecision(3) << files_ns / 1e6 << ',' << memory_ns / 1e6 << endl;
+        remove(svg_file.c_str());
+        remove(png_file.c_str());
+    }
+}
+
+// Pixels of an image that are not white, drawn by one call on a blank image.
+long painted_pixels(const PNGImage &img) {
+    long n = 0;
+    for (int y = 0; y < img.height(); y++)
+        for (int x = 0; x < img.width(); x++) {
+            Color c = img.at(x, y);
+            if (c.red != 255 || c.green != 255 || c.blue != 255) n++;
+        }
+    return n;
+}
+
+// One row of the raster table: time of one call, per pixel painted and per vertex,
+// left empty when there are none.
+void raster_row(const string &primitive, const string &shape, long pixels, long vertices, double ns) {
+    cout << primitive << ',' << shape << ',' << pixels << ',' << vertices << ',' << fixed << setprecision(1) << ns
+         << ',' << setprecision(4);
+    if (pixels) cout << ns / pixels;
+    cout << ',';
+    if (vertices) cout << ns / vertices;
+    cout << endl;
+}
+
+void bench_raster() {
+    cout << "# raster: primitives of PNGImage and Point, one row per shape" << endl
+         << "primitive,shape,pixels,vertices,ns,ns_per_pixel,ns_per_vertex" << endl;
+    const Color color = { 40, 90, 200 };
+    PNGImage    img(2048, 2048);
+
+    // Lines of each slope (dy/dx) and length, from the center to the right and down
+    for (int length : { 16, 256, 2000 }) {
+        for (double slope : { 0.0, 0.25, 1.0, 4.0, -1.0 }) {
+            bool   vertical = slope == -1.0;
+            int    dx = vertical ? 0 : (int)lround(length / sqrt(1 + slope * slope));
+            int    dy = vertical ? length : (int)lround(dx * slope);
+            Point  a = { 24, 24 }, b = { a.x + dx, a.y + dy };
+            img.reset(2048, 2048);
+            img.draw_line(a, b, color);
+            double ns = time_ns([&]() { img.draw_line(a, b, color); });
+            raster_row("draw_line", "slope " + (vertical ? string("inf") : to_string(slope).substr(0, 4)) + " length "
+                       + to_string(length), painted_pixels(img), 2, ns);
+        }
+    }
+
+    // Convex polygons by vertex count, then 64-vertex stars, more concave as the inner radius shrinks
+    for (int n : { 3, 16, 256, 4096 }) {
+        vector<Point> points = star(n, { 1024, 1024 }, 1000, 1000);
+        img.reset(2048, 2048);
+        img.draw_polygon(points, color);
+        double ns = time_ns([&]() { img.draw_polygon(points, color); });
+        raster_row("draw_polygon", "convex " + to_string(n), painted_pixels(img), n, ns);
+    }
+    for (int inner : { 900, 600, 300, 50 }) {
+        vector<Point> points = star(64, { 1024, 1024 }, 1000, inner);
+        img.reset(2048, 2048);
+        img.draw_polygon(points, color);
+        double ns = time_ns([&]() { img.draw_polygon(points, color); });
+        raster_row("draw_polygon", "star inner " + to_string(inner) + "/1000", painted_pixels(img), 64, ns);
+    }
+
+    // Circles by radius, and a flat ellipse
+    for (Point radius : { Point{ 4, 4 }, Point{ 32, 32 }, Point{ 256, 256 }, Point{ 1000, 1000 }, Point{ 1000, 40 } }) {
+        img.reset(2048, 2048);
+        img.draw_ellipse({ 1024, 1024 }, radius, color);
+        double ns = time_ns([&]() { img.draw_ellipse({ 1024, 1024 }, radius, color); });
+        raster_row("draw_ellipse", "radius " + to_string(radius.x) + "x" + to_string(radius.y), painted_pixels(img),
+                   0, ns);
+    }
+
+    // Point transformations, per point of a batch
+    vector<Point> points = star(10000, { 512, 512 }, 500, 300), out(points.size());
+    const Point   origin = { 100, 200 };
+    for (int degrees : { 0, 90, 30 }) {
+        double ns = time_ns([&]() {
+            for (size_t i = 0; i < points.size(); i++) out[i] = points[i].rotate(origin, degrees);
+        });
+        raster_row("Point::rotate", to_string(degrees) + " degrees", 0, points.size(), ns);
+    }
+    for (int factor : { 1, 3 }) {
+        double ns = time_ns([&]() {
+            for (size_t i = 0; i < points.size(); i++) out[i] = points[i].scale(origin, factor);
+        });
+        raster_row("Point::scale", "factor " + to_string(factor), 0, points.size(), ns);
+    }
+
+    // Colors, per call
+    for (const char *str : { "#FADFAA", "#fadfaa", "red", "white" }) {
+        Color  c;
+        double ns = time_ns([&]() { c = parse_color(str); });
+        raster_row("parse_color", str, 0, 0, ns);
+    }
+}
+
+// Options of the corpus benchmark, from the command line
+struct CorpusOptions {
+    string baseline;      // JSON file to compare with
+    string save_baseline; // JSON file to write the results to
+    double max_slowdown;  // Percentage over the baseline total of a case that fails the run
+    bool   regressed;     // Set when a case is slower than allowed
+
+    CorpusOptions() : max_slowdown(25), regressed(false) {}
+} corpus_options;
+
+const char *const PHASES[] = { "load", "parse", "draw", "save" };
+const int         PHASE_COUNT = 4;
+
+// Times of a case, in microseconds per phase, and their sum
+struct CorpusTimes {
+    double phase_us[PHASE_COUNT];
+    double total_us;
+};
+
+// Read a baseline written by write_corpus_baseline
+map<string, CorpusTimes> read_corpus_baseline(const string &file) {
+    ifstream in(file);
+    if (!in) throw runtime_error("Unable to read baseline " + file);
+    string                   json((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    map<string, CorpusTimes> baseline;
+    const string             key = "{\"name\": \"";
+    for (size_t at = json.find(key); at != string::npos; at = json.find(key, at + 1)) {
+        size_t       name_end = json.find('"', at + key.size());
+        size_t       end      = json.find('}', at);
+        string       name     = json.substr(at + key.size(), name_end - at - key.size());
+        CorpusTimes &times    = baseline[name];
+        auto         value    = [&](const string &field) {
+            size_t pos = json.find("\"" + field + "\": ", at);
+            if (pos == string::npos || pos > end) throw runtime_error(file + ": no " + field + " for " + name);
+            return strtod(json.c_str() + pos + field.size() + 4, nullptr);
+        };
+        for (int i = 0; i < PHASE_COUNT; i++) times.phase_us[i] = value(string(PHASES[i]) + "_us");
+        times.total_us = value("total_us");
+    }
+    return baseline;
+}
+
+void write_corpus_baseline(const string &file, const vector<pair<string, CorpusTimes>> &results) {
+    ofstream out(file);
+    out << "{\"cases\": [" << endl << fixed << setprecision(2);
+    for (size_t c = 0; c < results.size(); c++) {
+        out << "  {\"name\": \"" << results[c].first << '"';
+        for (int i = 0; i < PHASE_COUNT; i++) out << ", \"" << PHASES[i] << "_us\": " << results[c].second.phase_us[i];
+        out << ", \"total_us\": " << results[c].second.total_us << '}' << (c + 1 < results.size() ? "," : "") << endl;
+    }
+    out << "]}" << endl;
+    if (!out.flush()) throw runtime_error("Unable to write baseline " + file);
+}
+
+// Lion drawn n times larger, on a canvas n times wider and higher
+string scaled_canvas(int n) {
+    ifstream in("input/lion.svg");
+    string   lion((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    size_t   body = lion.find('>', lion.find("<svg")) + 1;
+    return "<svg width=\"" + to_string(800 * n) + "\" height=\"" + to_string(600 * n) + "\"><g transform=\"scale("
+           + to_string(n) + ")\">" + lion.substr(body, lion.rfind("</svg>") - body) + "</g></svg>";
+}
+
+// 200 stars of 16 n vertices
+string scaled_vertices(int n) {
+    ostringstream out;
+    out << "<svg width=\"1000\" height=\"1000\">";
+    for (int i = 0; i < 200; i++) {
+        out << "<polygon fill=\"#" << hex << setw(6) << setfill('0') << i * 0x050301 << dec << "\" points=\"";
+        for (const Point &p : star(16 * n, { 100 + i % 20 * 40, 100 + i / 20 * 80 }, 90, 40))
+            out << p.x << ',' << p.y << ' ';
+        out << "\"/>";
+    }
+    out << "</svg>";
+    return out.str();
+}
+
+// Groups nested depth levels deep, each with a rectangle and a translation
+string nested_groups(int depth) {
+    string svg = "<svg width=\"1000\" height=\"1000\">";
+    for (int i = 0; i < depth; i++) {
+        svg += "<g transform=\"translate(3,3)\"><rect x=\"0\" y=\"0\" width=\"200\" height=\"100\" fill=\"#"
+               + string(i % 2 ? "3366CC" : "CC6633") + "\"/>";
+    }
+    for (int i = 0; i < depth; i++) svg += "</g>";
+    return svg + "</svg>";
+}
+
+// A group of 20 polygons used n times
+string use_fanout(int n) {
+    string svg = "<svg width=\"1000\" height=\"1000\"><g id=\"tile\">";
+    for (int i = 0; i < 20; i++) {
+        svg += "<polygon fill=\"#FADFAA\" points=\"" + to_string(i) + ",0 " + to_string(i + 20) + ",10 " + to_string(i)
+               + ",20\"/>";
+    }
+    svg += "</g>";
+    for (int i = 1; i < n; i++) {
+        svg += "<use href=\"#tile\" transform=\"translate(" + to_string(i % 25 * 40) + "," + to_string(i / 25 * 25)
+               + ")\"/>";
+    }
+    return svg + "</svg>";
+}
+
+void bench_corpus() {
+    cout << "# corpus: phases of the conversion of every input file and of scaled variants" << endl
+         << "case,load_us,parse_us,draw_us,save_us,total_us,baseline_total_us,change_pct" << endl;
+
+    map<string, CorpusTimes> baseline;
+    if (!corpus_options.baseline.empty()) baseline = read_corpus_baseline(corpus_options.baseline);
+
+    // Inputs in name order, then the synthetic variants, written to a file so loading is timed too
+    vector<pair<string, string>> cases; // Name and file
+    ::DIR                       *directory = ::opendir("input");
+    if (directory == nullptr) throw runtime_error("Unable to open input directory");
+    while (::dirent *entry = ::readdir(directory)) {
+        string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".svg") == 0) {
+            cases.push_back({ name.substr(0, name.size() - 4), "input/" + name });
+        }
+    }
+    ::closedir(directory);
+    sort(cases.begin(), cases.end());
+    const vector<pair<string, string>> synthetic = {
+        { "canvas_x4", scaled_canvas(4) },    { "vertices_x1", scaled_vertices(1) },
+        { "vertices_x8", scaled_vertices(8) }, { "nesting_256", nested_groups(256) },
+        { "use_fanout_500", use_fanout(500) },
+    };
+    for (const auto &variant : synthetic) {
+        string file = "bench_corpus_" + variant.first + ".svg";
+        ofstream(file, ios::binary) << variant.second;
+        cases.push_back({ variant.first, file });
+    }
+
+    vector<pair<string, CorpusTimes>> results;
+    int                               regressions = 0;
+    const string                      png_file    = "bench_corpus.png";
+    for (const auto &c : cases) {
+        // Each phase starts from what the previous one left
+        string                text;
+        Document              document;
+        PNGImage              img(1, 1);
+        vector<unsigned char> png;
+        TransformChain        root;
+        CorpusTimes           times;
+        times.phase_us[0] = time_ns([&]() {
+            ifstream in(c.second, ios::binary);
+            text.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        }, 50) / 1e3;
+        times.phase_us[1] = time_ns([&]() { readSVG(text.data(), text.size(), document); }, 50) / 1e3;
+        times.phase_us[2] = time_ns([&]() {
+            img.reset(document.dimensions().x, document.dimensions().y);
+            for (SVGElement *e : document.elements()) {
+                if (e->coarseBounds(root).intersects(img.region())) e->draw(img, root);
+            }
+        }, 50) / 1e3;
+        times.phase_us[3] = time_ns([&]() {
+            encode_png(img, PNGOptions(), png);
+            ofstream(png_file, ios::binary).write((const char *)png.data(), png.size());
+        }, 50) / 1e3;
+        times.total_us = 0;
+        for (double us : times.phase_us) times.total_us += us;
+        results.push_back({ c.first, times });
+
+        cout << c.first << fixed << setprecision(2);
+        for (double us : times.phase_us) cout << ',' << us;
+        cout << ',' << times.total_us << ',';
+        auto base = baseline.find(c.first);
+        if (base != baseline.end()) {
+            double change = 100 * (times.total_us / base->second.total_us - 1);
+            cout << base->second.total_us << ',' << setprecision(1) << change;
+            if (change > corpus_options.max_slowdown) regressions++;
+        } else {
+            cout << ',';
+        }
+        cout << endl;
+    }
+    for (const auto &variant : synthetic) remove(("bench_corpus_" + variant.first + ".svg").c_str());
+    remove(png_file.c_str());
+
+    if (!corpus_options.save_baseline.empty()) write_corpus_baseline(corpus_options.save_baseline, results);
+    if (!baseline.empty()) {
+        cout << "# " << regressions << " of " << results.size() << " cases more than " << corpus_options.max_slowdown
+             << "% slower than " << corpus_options.baseline << endl;
+        if (regressions) corpus_options.regressed = true;
+    }
+}
+} // namespace svg
+
+// Benchmarks by name, in the order they run
+const vector<pair<string, void (*)()>> BENCHMARKS = {
+    { "draw_polygon", svg::bench_draw_polygon },
+    { "fill_span", svg::bench_fill_span },
+    { "transform_chain", svg::bench_transform_chain },
+    { "transform_batch", svg::bench_transform_batch },
+    { "document", svg::bench_document },
+    { "use_resolution", svg::bench_use_resolution },
+    { "read", svg::bench_read },
+    { "parsers", svg::bench_parsers },
+    { "display_list", svg::bench_display_list },
+    { "pixel_formats", svg::bench_pixel_formats },
+    { "scene", svg::bench_scene },
+    { "culling", svg::bench_culling },
+    { "occlusion", svg::bench_occlusion },
+    { "png_encode", svg::bench_png_encode },
+    { "render_memory", svg::bench_render_memory },
+    { "raster", svg::bench_raster },
+    { "corpus", svg::bench_corpus },
+};
+
+// bench [options] [name...] runs the named benchmarks, or all of them. Options of the corpus benchmark:
+//     --baseline=FILE        compare with a baseline, failing if a case is too slow
+//     --max-slowdown=PCT     slowdown over the baseline that fails, 25% by default
+//     --save-baseline=FILE   write the results as a baseline
+int main(int argc, char **argv) {
+    vector<string> names;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.compare(0, 11, "--baseline=") == 0) {
+            svg::corpus_options.baseline = arg.substr(11);
+        } else if (arg.compare(0, 15, "--max-slowdown=") == 0) {
+            svg::corpus_options.max_slowdown = atof(arg.c_str() + 15);
+        } else if (arg.compare(0, 16, "--save-baseline=") == 0) {
+            svg::corpus_options.save_baseline = arg.substr(16);
+        } else {
+            names.push_back(arg);
+        }
+    }
+    for (const string &name : names) {
+        if (none_of(BENCHMARKS.begin(), BENCHMARKS.end(), [&](const pair<string, void (*)()> &b) {
+                return b.first == name;
+            })) {
+            cerr << "Unknown benchmark " << name << ", one of:";
+            for (const auto &b : BENCHMARKS) cerr << ' ' << b.first;
+            cerr << endl;
+            return 1;
+        }
+    }
+    for (const auto &b : BENCHMARKS) {
+        if (names.empty() || find(names.begin(), names.end(), b.first) != names.end()) b.second();
+    }
+    return svg::corpus_options.regressed ? 2 : 0;
+}
@@ -1,15 +1,350 @@
 #include "SVGElements.hpp"
+#include "DisplayList.hpp"
+#include "Parallel.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 namespace svg {
 void convert(const std::string &svg_file, const std::string &png_file) {
-    Point                     dimensions;
-    std::vector<SVGElement *> svg_elements;
-    readSVG(svg_file, dimensions, svg_elements);
-    PNGImage img(dimensions.x, dimensions.y);
-    for (SVGElement *e : svg_elements) { e->draw(img); }
-    img.save(png_file);
-    for (SVGElement *e : svg_elements) { delete e; }
+    convert(svg_file, png_file, ConvertOptions());
+}
+
+void convert(const std::string &svg_file, const std::string &png_file, const ConvertOptions &options) {
+    Converter(options).convert(svg_file, png_file);
+}
+
+Converter::Converter(const ConvertOptions &options) : options_(options), img_(1, 1), rgba_(1, 1), gray_(1, 1) {}
+
+typedef std::chrono::steady_clock Clock;
+
+/// @brief              Time since a point in time
+/// @param start        Start time
+/// @return             Milliseconds since start
+static double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/// @brief              Check the extension of a file name
+/// @param file         File name
+/// @param extension    Extension, with the dot
+/// @return             true if the file has the extension
+static bool hasExtension(const std::string &file, const std::string &extension) {
+    return file.size() >= extension.size()
+           && file.compare(file.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+/// @brief              Count elements by tag name, with their descendants
+/// @param element      Element
+/// @param elements     Counts by tag name
+static void countElements(const SVGElement *element, std::map<std::string, size_t> &elements) {
+    elements[element->tag()]++;
+    if (const GroupElement *group = dynamic_cast<const GroupElement *>(element)) {
+        for (size_t i = 0; i < group->size(); i++) countElements(group->child(i), elements);
+    }
+}
+
+/// @brief              Count the elements and vertices of a document, if the options ask for statistics
+/// @param document     Document
+/// @param stats        Whether to count them
+/// @param out          Statistics counted in
+static void countDocument(const Document &document, bool stats, RenderStats &out) {
+    if (!stats) { return; }
+    for (const SVGElement *e : document.elements()) {
+        countElements(e, out.elements);
+        out.vertices += e->vertices();
+    }
+}
+
+void Converter::convert(const std::string &svg_file, const std::string &png_file) {
+    stats_ = RenderStats();
+    if (hasExtension(svg_file, ".svgdl")) {
+        renderDisplayList(svg_file, png_file);
+        return;
+    }
+
+    // The document keeps its arena memory from the last conversion
+    Clock::time_point start = Clock::now();
+    readSVG(svg_file, document_);
+    stats_.parseMs = millisecondsSince(start);
+    if (options_.pixelFormat == PixelFormat::RGB888) {
+        draw(svg_file);
+        save(img_, png_file);
+        return;
+    }
+
+    // The other pixel formats are drawn from a display list, whose compilation counts as drawing.
+    // Occluded elements are left out of the list, as they are left out of the drawing.
+    countDocument(document_, options_.stats, stats_);
+    start = Clock::now();
+    const Point                      dimensions = document_.dimensions();
+    const std::vector<SVGElement *> *elements   = &document_.elements();
+    if (options_.occlusionCulling) {
+        Box canvas    = { { 0, 0 }, { dimensions.x - 1, dimensions.y - 1 } };
+        stats_.culled = cullOccluded(*elements, canvas, options_.transformMode, visible_);
+        elements      = &visible_;
+    }
+    words_.clear();
+    compileDisplayList(*elements, dimensions, words_, options_.transformMode);
+    stats_.drawMs = millisecondsSince(start);
+    drawList(DisplayList(words_.data(), words_.size() * sizeof(uint32_t)), svg_file, png_file);
+}
+
+const PNGImage &Converter::render(const char *svg, size_t size) {
+    stats_                  = RenderStats();
+    Clock::time_point start = Clock::now();
+    readSVG(svg, size, document_);
+    stats_.parseMs = millisecondsSince(start);
+    draw("SVG text in memory");
+    return img_;
+}
+
+void Converter::renderPNG(const char *svg, size_t size, std::vector<unsigned char> &png) {
+    render(svg, size);
+    Clock::time_point start = Clock::now();
+    encode_png(img_, options_.png, png);
+    stats_.encodeMs = millisecondsSince(start);
+}
+
+template <class Format> void Converter::save(const BasicPNGImage<Format> &img, const std::string &png_file) {
+    Clock::time_point start = Clock::now();
+    img.save(png_file, options_.png);
+    stats_.encodeMs = millisecondsSince(start);
+
+    if (options_.overdraw) {
+        std::string name = hasExtension(png_file, ".png") ? png_file.substr(0, png_file.size() - 4) : png_file;
+        PNGImage    heat(img.width(), img.height());
+        drawOverdraw(writes_, heat);
+        heat.save(name + "_overdraw.png", options_.png);
+    }
+}
+
+template <class Format> void Converter::startCounting(BasicPNGImage<Format> &img) {
+    if (options_.overdraw) {
+        writes_.assign((size_t)img.width() * img.height(), 0);
+        stats_.drawn.writes = writes_.data();
+        stats_.drawn.stride = img.width();
+    }
+    img.count(options_.stats || options_.overdraw ? &stats_.drawn : nullptr);
+}
+
+void drawOverdraw(const std::vector<uint32_t> &writes, PNGImage &heat) {
+    static const Color colors[9] = {
+        { 0, 0, 0 },     { 0, 0, 160 }, { 0, 160, 0 }, { 220, 220, 0 },  { 255, 140, 0 }, // 0 to 4 writes
+        { 255, 0, 0 },   { 255, 0, 0 }, { 255, 0, 0 }, { 255, 255, 255 },                 // 5 to 7, and more
+    };
+    for (int y = 0; y < heat.height(); y++) {
+        for (int x = 0; x < heat.width(); x++) {
+            heat.at(x, y) = colors[std::min<uint32_t>(writes[(size_t)y * heat.width() + x], 8)];
+        }
+    }
+}
+
+std::string RenderStats::json() const {
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    out << "{\"parse_ms\": " << parseMs << ", \"draw_ms\": " << drawMs << ", \"encode_ms\": " << encodeMs
+        << ", \"elements\": {";
+    for (auto e = elements.begin(); e != elements.end(); ++e) {
+        out << (e == elements.begin() ? "" : ", ") << '"' << e->first << "\": " << e->second;
+    }
+    out << "}, \"vertices\": " << vertices << ", \"pixels_written\": " << drawn.pixels
+        << ", \"spans_filled\": " << drawn.spans << ", \"culled\": " << culled << '}';
+    return out.str();
+}
+
+void Converter::draw(const std::string &name) {
+    Point dimensions = document_.dimensions();
+    if (dimensions.x <= 0 || dimensions.y <= 0) { throw std::runtime_error(name + ": invalid image dimensions"); }
+    countDocument(document_, options_.stats, stats_);
+
+    Clock::time_point start = Clock::now();
+    img_.reset(dimensions.x, dimensions.y);
+    startCounting(img_);
+    const std::vector<SVGElement *> *elements = &document_.elements();
+    if (options_.occlusionCulling) {
+        stats_.culled = cullOccluded(*elements, img_.region(), options_.transformMode, visible_);
+        elements      = &visible_;
+    }
+    if (options_.tileSize > 0) {
+        drawTiled(*elements, img_, options_.tileSize, options_.threads, options_.transformMode);
+    } else {
+        TransformChain root(options_.transformMode);
+        for (SVGElement *e : *elements) {
+            if (e->coarseBounds(root).intersects(img_.region())) { e->draw(img_, root); }
+        }
+    }
+    img_.count(nullptr);
+    stats_.drawMs = millisecondsSince(start);
+}
+
+void Converter::compile(const std::string &svg_file, const std::string &dl_file) {
+    readSVG(svg_file, document_);
+    words_.clear();
+    compileDisplayList(document_, words_, options_.transformMode);
+
+    std::ofstream out(dl_file, std::ios::binary);
+    out.write((const char *)words_.data(), words_.size() * sizeof(uint32_t));
+    if (!out.flush()) throw std::runtime_error("Unable to write " + dl_file);
+}
+
+/// @brief              Counters for the tiles of an image, sharing its per pixel writes
+/// @param img          Image
+/// @param tiles        Number of tiles
+/// @return             Counters of each tile, none if the image is not counting
+template <class Format> static std::vector<DrawCounters> tileCounters(const BasicPNGImage<Format> &img, size_t tiles) {
+    DrawCounters tile;
+    if (img.counters()) {
+        tile.writes = img.counters()->writes;
+        tile.stride = img.counters()->stride;
+    }
+    return std::vector<DrawCounters>(img.counters() ? tiles : 0, tile);
+}
+
+/// @brief              Add the counters of tiles to those of the image they were pasted on
+/// @param img          Image
+/// @param tiles        Counters of each tile
+template <class Format>
+static void addTileCounters(const BasicPNGImage<Format> &img, const std::vector<DrawCounters> &tiles) {
+    if (!img.counters()) { return; }
+    for (const DrawCounters &tile : tiles) {
+        img.counters()->pixels += tile.pixels;
+        img.counters()->spans  += tile.spans;
+    }
+}
+
+void Converter::renderDisplayList(const std::string &dl_file, const std::string &png_file) {
+    Clock::time_point start = Clock::now();
+    DisplayListFile   file(dl_file);
+    stats_.parseMs = millisecondsSince(start);
+    drawList(file.list(), dl_file, png_file);
+}
+
+void Converter::drawList(const DisplayList &list, const std::string &name, const std::string &png_file) {
+    switch (options_.pixelFormat) {
+    case PixelFormat::RGB888: renderList(list, img_, name, png_file); break;
+    case PixelFormat::RGBA8888: renderList(list, rgba_, name, png_file); break;
+    case PixelFormat::Gray8: renderList(list, gray_, name, png_file); break;
+    }
+}
+
+template <class Format>
+void Converter::renderList(
+    const DisplayList &list, BasicPNGImage<Format> &img, const std::string &name, const std::string &png_file
+) {
+    if (list.width() <= 0 || list.height() <= 0) { throw std::runtime_error(name + ": invalid image dimensions"); }
+
+    Clock::time_point start = Clock::now();
+    img.reset(list.width(), list.height());
+    startCounting(img);
+    if (options_.tileSize > 0) {
+        // Each tile draws the commands whose bounding box reaches it
+        const int                 tileSize = options_.tileSize;
+        const int                 tiles_x  = (img.width() + tileSize - 1) / tileSize;
+        const int                 tiles_y  = (img.height() + tileSize - 1) / tileSize;
+        std::vector<DrawCounters> counters = tileCounters(img, tiles_x * tiles_y);
+        parallelFor(tiles_x * tiles_y, options_.threads, [&](size_t i) {
+            int                   x = (int)(i % tiles_x) * tileSize;
+            int                   y = (int)(i / tiles_x) * tileSize;
+            BasicPNGImage<Format> tile(
+                x, y, std::min(tileSize, img.width() - x), std::min(tileSize, img.height() - y)
+            );
+            if (!counters.empty()) { tile.count(&counters[i]); }
+            list.render(tile);
+            img.paste(tile);
+        });
+        addTileCounters(img, counters);
+    } else {
+        list.render(img);
+    }
+    img.count(nullptr);
+    stats_.drawMs += millisecondsSince(start);
+    save(img, png_file);
+}
+
+void drawTiled(
+    const std::vector<SVGElement *> &elements, PNGImage &img, int tileSize, unsigned threads, TransformMode mode
+) {
+    const int tiles_x = (img.width() + tileSize - 1) / tileSize;
+    const int tiles_y = (img.height() + tileSize - 1) / tileSize;
+
+    const TransformChain root(mode);
+
+    // Bin elements by the tiles their cached bounds overlap, keeping painter's order
+    std::vector<std::vector<const SVGElement *>> bins(tiles_x * tiles_y);
+    for (const SVGElement *e : elements) {
+        Box box = e->coarseBounds(root);
+        if (!box.intersects(img.region())) { continue; }
+        int tx_from = std::max(box.min.x, 0) / tileSize;
+        int tx_to   = std::min(box.max.x, img.width() - 1) / tileSize;
+        int ty_from = std::max(box.min.y, 0) / tileSize;
+        int ty_to   = std::min(box.max.y, img.height() - 1) / tileSize;
+        for (int ty = ty_from; ty <= ty_to; ty++)
+            for (int tx = tx_from; tx <= tx_to; tx++) bins[ty * tiles_x + tx].push_back(e);
+    }
+
+    // Each worker takes the next tile, draws its elements and copies it to the image.
+    // Tiles cover disjoint pixels, so workers never write to the same memory.
+    std::vector<DrawCounters> counters = tileCounters(img, bins.size());
+    parallelFor(bins.size(), threads, [&](size_t i) {
+        if (bins[i].empty()) { return; } // Tile stays blank
+        int      x = (int)(i % tiles_x) * tileSize;
+        int      y = (int)(i / tiles_x) * tileSize;
+        PNGImage tile(x, y, std::min(tileSize, img.width() - x), std::min(tileSize, img.height() - y));
+        if (!counters.empty()) { tile.count(&counters[i]); }
+        for (const SVGElement *e : bins[i]) { e->draw(tile, root); }
+        img.paste(tile);
+    });
+    addTileCounters(img, counters);
+}
+
+size_t cullOccluded(
+    const std::vector<SVGElement *> &elements, const Box &canvas, TransformMode mode, std::vector<SVGElement *> &visible
+) {
+    const int TILE    = 8;
+    const int tiles_x = (canvas.max.x - canvas.min.x) / TILE + 1;
+    const int tiles_y = (canvas.max.y - canvas.min.y) / TILE + 1;
+
+    // Tiles whose pixels in the canvas are all painted by the elements visited so far
+    std::vector<bool> covered(tiles_x * tiles_y, false);
+    TransformChain    root(mode);
+    Point             origin = { -canvas.min.x, -canvas.min.y }; // Moves canvas pixels to mask pixels
+    size_t            culled = 0;
+    visible.clear();
+    for (size_t i = elements.size(); i-- > 0;) {
+        SVGElement *e   = elements[i];
+        Box         box = e->coarseBounds(root).intersect(canvas);
+        if (!box.is_empty()) {
+            Point from = box.min.translate(origin), to = box.max.translate(origin);
+            bool  hidden = true;
+            for (int ty = from.y / TILE; hidden && ty <= to.y / TILE; ty++)
+                for (int tx = from.x / TILE; hidden && tx <= to.x / TILE; tx++) hidden = covered[ty * tiles_x + tx];
+            if (hidden) {
+                culled++;
+                continue;
+            }
+        }
+        visible.push_back(e);
+
+        // Tiles inside the covered box. The parts of the last tiles outside the canvas need no cover.
+        Box cover = e->coverage(root).intersect(canvas);
+        if (cover.is_empty()) continue;
+        Point from    = cover.min.translate(origin), to = cover.max.translate(origin);
+        int   tx_from = (from.x + TILE - 1) / TILE;
+        int   ty_from = (from.y + TILE - 1) / TILE;
+        int   tx_to   = cover.max.x == canvas.max.x ? tiles_x - 1 : (to.x + 1) / TILE - 1;
+        int   ty_to   = cover.max.y == canvas.max.y ? tiles_y - 1 : (to.y + 1) / TILE - 1;
+        for (int ty = ty_from; ty <= ty_to; ty++)
+            for (int tx = tx_from; tx <= tx_to; tx++) covered[ty * tiles_x + tx] = true;
+    }
+    std::reverse(visible.begin(), visible.end());
+    return culled;
 }
 } // namespace svg
\ No newline at end of file
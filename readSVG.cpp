@@ -1,7 +1,15 @@
 #include "SVGElements.hpp"
 #include "external/tinyxml2/tinyxml2.h"
-#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 using namespace std;
@@ -9,251 +17,638 @@ using namespace tinyxml2;
 
 namespace svg {
 
-void readSVG(const string &svg_file, Point &dimensions, vector<SVGElement *> &svg_elements) {
-    // Load SVG FIle
-    XMLDocument doc;
-    XMLError    r = doc.LoadFile(svg_file.c_str());
-    if (r != XML_SUCCESS) throw runtime_error("Unable to load " + svg_file); // Abort if Errors
+/// @brief  Incremental reader of XML tags. Reads the text in blocks, or straight
+///         from memory, and reports the start and end of each tag to a builder,
+///         skipping text, comments, declarations and processing instructions.
+class TagReader {
+  private:
+    static const size_t BLOCK = 64 * 1024;
+
+    istream       *in_; // nullptr when reading from memory
+    const string  &name_;
+    vector<char>   buffer_; // Blocks read from in_
+    const char    *text_;   // Text read so far, in buffer_ or in the caller's memory
+    size_t         size_;   // Size of text_
+    size_t         begin_;  // Start of the unread text
+    vector<char>   tag_;    // Copy of the current tag, changed while parsing it
+    Attributes     attributes_;
+    vector<string> open_; // Names of the open tags
+
+    /// @brief  Throw the error for the source
+    [[noreturn]] void fail(const string &what) const { throw runtime_error("Unable to load " + name_ + ": " + what); }
+
+    /// @brief          Read the next block, dropping the text already read
+    /// @return         false at the end of the input
+    bool more();
+
+    /// @brief          Check the text at begin_, reading more blocks if needed
+    /// @param text     Text expected
+    /// @return         true if the unread text starts with text
+    bool startsWith(const char *text);
+
+    /// @brief          Find text in the unread text, reading more blocks if needed
+    /// @param from     Offset from begin_ where to start looking
+    /// @param text     Text to find
+    /// @return         Offset from begin_ of the text, or -1 at the end of the input
+    long find(size_t from, const char *text);
+
+    /// @brief          Find the end of a tag, skipping quoted attribute values
+    /// @return         Offset from begin_ of the '>', or -1 at the end of the input
+    long findTagEnd();
+
+    /// @brief          Parse a start tag in place and report it
+    /// @param tag      Text between '<' and '>', changed to hold null terminated names and values
+    /// @param builder  Builder to report to
+    void startTag(char *tag, DocumentBuilder &builder);
+
+  public:
+    /// @param in       Stream with the XML text
+    /// @param name     Name of the source, for error messages
+    TagReader(istream &in, const string &name) : in_(&in), name_(name), text_(nullptr), size_(0), begin_(0) {}
+
+    /// @param data     XML text, read in place
+    /// @param size     Size of the text
+    /// @param name     Name of the source, for error messages
+    TagReader(const char *data, size_t size, const string &name)
+        : in_(nullptr), name_(name), text_(data), size_(size), begin_(0) {}
+
+    /// @brief          Read all tags
+    /// @param builder  Builder to report the tags to
+    void read(DocumentBuilder &builder);
+};
+
+bool TagReader::more() {
+    if (!in_ || !*in_) return false;
+    size_t unread = size_ - begin_;
+    if (unread) ::memmove(buffer_.data(), text_ + begin_, unread);
+    buffer_.resize(unread + BLOCK);
+    in_->read(buffer_.data() + unread, BLOCK);
+    text_  = buffer_.data();
+    size_  = unread + in_->gcount();
+    begin_ = 0;
+    return in_->gcount() > 0;
+}
 
-    // Get Dimensions
-    XMLElement *xml_elem = doc.RootElement();
-    dimensions.x         = xml_elem->IntAttribute("width");
-    dimensions.y         = xml_elem->IntAttribute("height");
+bool TagReader::startsWith(const char *text) {
+    const size_t length = ::strlen(text);
+    while (size_ - begin_ < length)
+        if (!more()) return false;
+    return ::memcmp(text_ + begin_, text, length) == 0;
+}
 
-    XMLNode *node = doc.FirstChild(); // <svg> Node
-    if (node->NoChildren()) return;   // Check if there are any elements
+long TagReader::find(size_t from, const char *text) {
+    const size_t length = ::strlen(text);
+    for (;;) {
+        const char *end   = text_ + size_;
+        const char *found = std::search(text_ + begin_ + from, end, text, text + length);
+        if (found != end) return found - (text_ + begin_);
+
+        // Search the new text, and the end of the old one in case the match is split
+        size_t unread = size_ - begin_;
+        from          = unread >= length ? unread - length + 1 : 0;
+        if (!more()) return -1;
+    }
+}
 
-    // Create auxilary vector to store all elements (including subElements) with ID's
-    vector<SVGElement *> svg_elems_id;
+long TagReader::findTagEnd() {
+    // Quoted values may hold '>', so the tag ends at a '>' with no open quote before it
+    size_t from = 0;
+    for (;;) {
+        long close = find(from, ">");
+        if (close < 0) return -1;
+        const char *tag   = text_ + begin_;
+        char        quote = 0;
+        for (long i = 0; i < close; i++) {
+            if (quote ? tag[i] == quote : (tag[i] == '"' || tag[i] == '\'')) quote = quote ? 0 : tag[i];
+        }
+        if (!quote) return close;
+        from = close + 1;
+    }
+}
 
-    // First actual Element
-    XMLElement *element = node->FirstChildElement();
+/// @brief      Decode a character reference, "&#N;" or "&#xN;", to UTF-8
+/// @param in   Text starting with "&#"
+/// @param out  Where the UTF-8 bytes are written, at most 4, fewer than the reference's
+/// @return     Length of the reference, 0 if it is not a valid one
+static size_t decodeCharacterReference(const char *in, char *&out) {
+    bool        hex    = in[2] == 'x';
+    const char *digits = in + (hex ? 3 : 2), *p = digits;
+    uint32_t    code   = 0;
+    for (; hex ? ::isxdigit((unsigned char)*p) : ::isdigit((unsigned char)*p); p++) {
+        code = code * (hex ? 16 : 10) + (::isdigit((unsigned char)*p) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+        if (code > 0x10FFFF) return 0;
+    }
+    if (p == digits || *p != ';' || code == 0 || (code >= 0xD800 && code <= 0xDFFF)) return 0;
+    if (code < 0x80) {
+        *out++ = (char)code;
+    } else if (code < 0x800) {
+        *out++ = (char)(0xC0 | code >> 6);
+        *out++ = (char)(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        *out++ = (char)(0xE0 | code >> 12);
+        *out++ = (char)(0x80 | (code >> 6 & 0x3F));
+        *out++ = (char)(0x80 | (code & 0x3F));
+    } else {
+        *out++ = (char)(0xF0 | code >> 18);
+        *out++ = (char)(0x80 | (code >> 12 & 0x3F));
+        *out++ = (char)(0x80 | (code >> 6 & 0x3F));
+        *out++ = (char)(0x80 | (code & 0x3F));
+    }
+    return p + 1 - in;
+}
 
-    // Loop Through Elements
-    for (; element != nullptr; element = element->NextSiblingElement())
-        parseElement(element, svg_elements, svg_elems_id); // Parse Element
+/// @brief      Replace the XML entities and character references of a value in place
+/// @param str  Null terminated value
+static void decodeEntities(char *str) {
+    static const struct {
+        const char *entity;
+        char        c;
+    } entities[] = {
+        { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '"' }, { "&apos;", '\'' }
+    };
+    char *out = str;
+    for (const char *in = str; *in;) {
+        bool replaced = false;
+        if (in[0] == '&' && in[1] == '#') {
+            size_t length = decodeCharacterReference(in, out);
+            in           += length;
+            replaced      = length > 0;
+        } else if (*in == '&') {
+            for (const auto &e : entities) {
+                size_t length = ::strlen(e.entity);
+                if (::strncmp(in, e.entity, length) == 0) {
+                    *out++   = e.c;
+                    in      += length;
+                    replaced = true;
+                    break;
+                }
+            }
+        }
+        if (!replaced) *out++ = *in++;
+    }
+    *out = '\0';
 }
 
-void parseElement(
-    const XMLElement *element, vector<SVGElement *> &elementList, vector<SVGElement *> &elementListID,
-    const vector<Transform> &transforms
-) {
-    const char *p = nullptr;                                 // Temporary Pointer Variable Declaration
+void TagReader::startTag(char *tag, DocumentBuilder &builder) {
+    // A tag is "name attr="value" ... [/]"
+    size_t length = ::strlen(tag);
+    bool   empty  = length && tag[length - 1] == '/';
+    if (empty) tag[length - 1] = '\0';
+
+    char *p    = tag;
+    char *name = p;
+    while (*p && !::isspace((unsigned char)*p)) p++;
+    if (p == name) fail("tag without a name");
+    if (*p) *p++ = '\0';
+
+    attributes_.clear();
+    for (;;) {
+        while (::isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+
+        // Name
+        char *attr = p;
+        while (*p && *p != '=' && !::isspace((unsigned char)*p)) p++;
+        char *attr_end = p;
+        while (::isspace((unsigned char)*p)) p++;
+        if (*p != '=') fail(string("attribute without value in <") + name + ">");
+        *attr_end = '\0';
+        p++;
+
+        // Value
+        while (::isspace((unsigned char)*p)) p++;
+        if (*p != '"' && *p != '\'') fail(string("unquoted attribute value in <") + name + ">");
+        char  quote = *p++;
+        char *value = p;
+        while (*p != quote) p++; // Quotes are balanced, see findTagEnd()
+        *p++ = '\0';
+        decodeEntities(value);
+        attributes_.add(attr, value);
+    }
+
+    builder.start(name, attributes_);
+    if (empty) {
+        builder.end();
+    } else {
+        open_.push_back(name);
+    }
+}
 
-    const string elemName = element->Name();                 // Get Element Name
+void TagReader::read(DocumentBuilder &builder) {
+    bool root = false; // Root element was read
+    for (;;) {
+        // Text before the next tag is not used
+        long open = find(0, "<");
+        const char *text = text_ + begin_, *end_text = open < 0 ? text_ + size_ : text + open;
+        if (std::find(text, end_text, '\0') != end_text) fail("null character in text");
+        if (open < 0) break;
+        begin_ += open;
+
+        // The tag ends at begin_ + end, with its '>'
+        long end;
+        if (startsWith("<!--")) {
+            end = find(4, "-->") + 2;
+        } else if (startsWith("<![CDATA[")) {
+            end = find(9, "]]>") + 2;
+        } else if (startsWith("<?")) {
+            end = find(2, "?>") + 1;
+        } else {
+            end = findTagEnd();
+        }
+        if (end < 2) fail("unterminated tag");
+
+        // Parse a copy of the tag without its '>', leaving the source untouched
+        tag_.assign(text_ + begin_, text_ + begin_ + end);
+        tag_.push_back('\0');
+        char *tag = tag_.data();
+        if (::strlen(tag) != (size_t)end) fail("null character in text");
+
+        if (tag[1] == '/') {
+            // End tag, which must close the last open tag
+            char *name = tag + 2;
+            long  last = end;
+            while (last > 2 && ::isspace((unsigned char)tag[last - 1])) last--;
+            tag[last] = '\0';
+            if (open_.empty() || open_.back() != name) fail(string("unexpected </") + name + ">");
+            open_.pop_back();
+            builder.end();
+        } else if (tag[1] != '!' && tag[1] != '?') {
+            if (open_.empty() && root) fail("more than one root element");
+            root = true;
+            startTag(tag + 1, builder);
+        }
+        begin_ += end + 1;
+    }
+    if (!open_.empty()) fail("<" + open_.back() + "> is not closed");
+    if (!root) fail("no root element");
+    builder.finish();
+}
 
-    p               = element->Attribute("id");              // Get Element ID
-    const string id = p ? p : "";                            // Element might not have an ID
+void readSVG(const string &svg_file, Document &document) {
+    ifstream in(svg_file, ios::binary);
+    if (!in) throw runtime_error("Unable to load " + svg_file); // Abort if Errors
+    readSVG(in, svg_file, document);
+}
 
-    vector<Transform> elemTransformList;                     // Generate List of Transformations
-    const Transform   elemTransform = getTransform(element); // Get Element Transformation
-    elemTransformList.push_back(elemTransform);              // Add Element Transformation
+void readSVG(istream &in, const string &name, Document &document) {
+    DocumentBuilder builder(document);
+    TagReader(in, name).read(builder);
+}
 
-    // Append Inherited Transformations
-    // This are inserted after because inherited
-    // transformations need to be applied last
-    elemTransformList.insert(elemTransformList.end(), transforms.begin(), transforms.end());
+void readSVG(const char *data, size_t size, Document &document) {
+    static const string name = "SVG text in memory";
+    DocumentBuilder     builder(document);
+    TagReader(data, size, name).read(builder);
+}
 
+/// @brief              Report an element of a XML document and its descendants to a builder
+/// @param element      Element
+/// @param attributes   Buffer for the attributes
+/// @param builder      Builder
+static void walk(const XMLElement *element, Attributes &attributes, DocumentBuilder &builder) {
+    attributes.clear();
+    for (const XMLAttribute *attr = element->FirstAttribute(); attr; attr = attr->Next())
+        attributes.add(attr->Name(), attr->Value());
+    builder.start(element->Name(), attributes);
+
+    // Loop Through Children
+    for (const XMLElement *child = element->FirstChildElement(); child; child = child->NextSiblingElement())
+        walk(child, attributes, builder);
+    builder.end();
+}
 
-    // Create Element Pointer
-    SVGElement *eP = nullptr;
+void readSVG(XMLDocument &doc, const string &svg_file, Document &document) {
+    DocumentBuilder builder(document);
 
-    // Parse Each Element Differently
+    // Load SVG FIle
+    XMLError r = doc.LoadFile(svg_file.c_str());
+    if (r != XML_SUCCESS) throw runtime_error("Unable to load " + svg_file); // Abort if Errors
 
-    // Ellipse
-    if (elemName == "ellipse") {
-        // Parse Color
-        Color color = parse_color(element->Attribute("fill"));
+    Attributes attributes;
+    walk(doc.RootElement(), attributes, builder);
+    builder.finish();
+}
 
-        // Parse Center and Radius
-        Point center({ element->IntAttribute("cx"), element->IntAttribute("cy") });
-        Point radius({ element->IntAttribute("rx"), element->IntAttribute("ry") });
+const char *Attributes::get(const char *name) const {
+    for (const pair<const char *, const char *> &attr : list_)
+        if (::strcmp(attr.first, name) == 0) return attr.second;
+    return nullptr;
+}
 
-        // Create Element
-        eP = new Ellipse(id, elemTransformList, color, center, radius);
+/// @brief          Read an integer like `istream >> int` does: white space, an optional
+///                 sign and decimal digits
+/// @param p        Text
+/// @param value    Integer read, 0 if there are no digits, INT_MAX or INT_MIN if it overflows
+/// @param commas   Skip commas like white space
+/// @return         Position after the integer, nullptr if there is no integer or it overflows
+static const char *readInt(const char *p, int &value, bool commas) {
+    while (*p == ' ' || (*p >= '\t' && *p <= '\r') || (commas && *p == ',')) p++;
+
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+') p++;
+
+    value = 0;
+    if (*p < '0' || *p > '9') return nullptr;
+    // Fails like the stream, which stores the nearest int on overflow
+    const long long limit = negative ? -(long long)INT_MIN : INT_MAX;
+    long long       v     = 0;
+    for (; *p >= '0' && *p <= '9'; p++) {
+        v = v * 10 + (*p - '0');
+        if (v > limit) {
+            value = negative ? INT_MIN : INT_MAX;
+            return nullptr;
+        }
     }
+    value = (int)(negative ? -v : v);
+    return p;
+}
+
+int Attributes::getInt(const char *name) const {
+    int         number = 0;
+    const char *value  = get(name);
+    if (value) readInt(value, number, false);
+    return number;
+}
+
+DocumentBuilder::DocumentBuilder(Document &document) : document_(document), depth_(0), skip_(0) {
+    document_.clear();
+}
+
+void DocumentBuilder::start(const char *name, const Attributes &attributes) {
+    depth_++;
 
-    // Circle
-    if (elemName == "circle") {
-        // Parse Color
-        Color color = parse_color(element->Attribute("fill"));
+    // Root: Get Dimensions
+    if (depth_ == 1) {
+        document_.setDimensions({ attributes.getInt("width"), attributes.getInt("height") });
+        return;
+    }
 
-        // Parse Center and Radius
-        Point center({ element->IntAttribute("cx"), element->IntAttribute("cy") });
-        int   radius = element->IntAttribute("r");
+    // Contents of elements that are not groups are ignored
+    if (skip_) {
+        skip_++;
+        return;
+    }
 
-        // Create Element
-        eP = new Circle(id, elemTransformList, color, center, radius);
+    // Element Name Dispatch Table, groups are handled apart
+    static const struct {
+        const char *name;
+        Build       build;
+    } BUILDERS[] = {
+        { "ellipse", &DocumentBuilder::buildEllipse },
+        { "circle", &DocumentBuilder::buildCircle },
+        { "polyline", &DocumentBuilder::buildPolyLine },
+        { "line", &DocumentBuilder::buildLine },
+        { "polygon", &DocumentBuilder::buildPolyGon },
+        { "rect", &DocumentBuilder::buildRectangle },
+        { "use", &DocumentBuilder::buildUse },
+    };
+
+    const char  *p  = attributes.get("id"); // Get Element ID
+    const string id = p ? p : "";           // Element might not have an ID
+
+    // Get Element Transformation
+    // Inherited transformations are applied when drawing
+    const Transform elemTransform = getTransform(attributes);
+
+    // Group: its Children come next, the element is created at its end tag
+    if (::strcmp(name, "g") == 0) {
+        groups_.push_back({ id, elemTransform, children_.size() });
+        return;
     }
+    skip_ = 1;
+
+    // Parse Each Element Differently, unknown elements are ignored
+    for (const auto &entry : BUILDERS) {
+        if (::strcmp(entry.name, name) != 0) continue;
+        SVGElement *eP = (this->*entry.build)(id, elemTransform, attributes);
+        if (eP) add(eP, id);
+        return;
+    }
+}
 
-    // PolyLine
-    if (elemName == "polyline") {
-        // Parse Color
-        Color color = parse_color(element->Attribute("stroke"));
+SVGElement *DocumentBuilder::buildEllipse(const string &id, const Transform &t, const Attributes &a) {
+    // Parse Color
+    Color color = parse_color(a.get("fill"));
 
-        // Read Points
-        vector<Point> points;
-        string        pStr(element->Attribute("points"));
+    // Parse Center and Radius
+    Point center({ a.getInt("cx"), a.getInt("cy") });
+    Point radius({ a.getInt("rx"), a.getInt("ry") });
 
-        // Substitute possible ',' for ' ' (spaces)
-        for (auto itr = pStr.begin(); itr != pStr.end(); ++itr)
-            if (*itr == ',') *itr = ' ';
+    // Create Element
+    return document_.arena().create<Ellipse>(document_.arena(), id, t, color, center, radius);
+}
 
-        // Parse Points
-        istringstream issPoints(pStr);
-        int           x;
-        int           y;
-        while (issPoints >> x >> y) points.push_back({ x, y });
+SVGElement *DocumentBuilder::buildCircle(const string &id, const Transform &t, const Attributes &a) {
+    // Parse Color
+    Color color = parse_color(a.get("fill"));
 
-        // Create Element
-        eP = new PolyLine(id, elemTransformList, points, color);
-    }
+    // Parse Center and Radius
+    Point center({ a.getInt("cx"), a.getInt("cy") });
+    int   radius = a.getInt("r");
 
-    // Line
-    if (elemName == "line") {
-        // Parse Color
-        Color color = parse_color(element->Attribute("stroke"));
+    // Create Element
+    return document_.arena().create<Circle>(document_.arena(), id, t, color, center, radius);
+}
 
-        // Parse Points
-        Point point1 = { element->IntAttribute("x1"), element->IntAttribute("y1") };
-        Point point2 = { element->IntAttribute("x2"), element->IntAttribute("y2") };
+SVGElement *DocumentBuilder::buildPolyLine(const string &id, const Transform &t, const Attributes &a) {
+    // Parse Color
+    Color color = parse_color(a.get("stroke"));
 
-        // Create Element
-        eP = new Line(id, elemTransformList, point1, point2, color);
-    }
+    // Parse Points, into the reused buffer
+    parsePoints(a.get("points"), points_);
 
-    // PolyGon
-    if (elemName == "polygon") {
-        // Parse Color
-        Color color = parse_color(element->Attribute("fill"));
+    // Create Element, which copies the Points to the arena
+    return document_.arena().create<PolyLine>(document_.arena(), id, t, points_, color);
+}
 
-        // Read Points
-        vector<Point> points;
-        string        pStr(element->Attribute("points"));
+SVGElement *DocumentBuilder::buildLine(const string &id, const Transform &t, const Attributes &a) {
+    // Parse Color
+    Color color = parse_color(a.get("stroke"));
 
-        // Substitute possible ',' for ' ' (spaces)
-        for (auto itr = pStr.begin(); itr != pStr.end(); ++itr)
-            if (*itr == ',') *itr = ' ';
+    // Parse Points
+    Point point1 = { a.getInt("x1"), a.getInt("y1") };
+    Point point2 = { a.getInt("x2"), a.getInt("y2") };
 
-        // Parse Points
-        istringstream issPoints(pStr);
-        int           x;
-        int           y;
-        while (issPoints >> x >> y) points.push_back({ x, y });
+    // Create Element
+    return document_.arena().create<Line>(document_.arena(), id, t, point1, point2, color);
+}
 
-        // Create Element
-        eP = new PolyGon(id, elemTransformList, points, color);
-    }
+SVGElement *DocumentBuilder::buildPolyGon(const string &id, const Transform &t, const Attributes &a) {
+    // Parse Color
+    Color color = parse_color(a.get("fill"));
 
-    // Rectangle
-    if (elemName == "rect") {
-        // Parse Color
-        p           = element->Attribute("fill");
-        Color color = parse_color(p);
+    // Parse Points, into the reused buffer
+    parsePoints(a.get("points"), points_);
 
-        // Parse Origin, Width and Height
-        Point origin = { element->IntAttribute("x"), element->IntAttribute("y") };
-        int   width  = element->IntAttribute("width");
-        int   height = element->IntAttribute("height");
+    // Create Element, which copies the Points to the arena
+    return document_.arena().create<PolyGon>(document_.arena(), id, t, points_, color);
+}
 
-        // Create Element
-        eP = new Rectangle(id, elemTransformList, color, origin, width, height);
-    }
+SVGElement *DocumentBuilder::buildRectangle(const string &id, const Transform &t, const Attributes &a) {
+    // Parse Color
+    Color color = parse_color(a.get("fill"));
+
+    // Parse Origin, Width and Height
+    Point origin = { a.getInt("x"), a.getInt("y") };
+    int   width  = a.getInt("width");
+    int   height = a.getInt("height");
+
+    // Create Element
+    return document_.arena().create<Rectangle>(document_.arena(), id, t, color, origin, width, height);
+}
+
+SVGElement *DocumentBuilder::buildUse(const string &id, const Transform &t, const Attributes &a) {
+    // A use without href draws nothing, like one whose reference is never found
+    const char *value = a.get("href");
+    if (!value || !*value) return document_.arena().create<UseElement>(document_.arena(), id, t, nullptr);
+
+    // Get href ignoring "#" caracter
+    string href(value + 1);
+
+    // Find Matching Element, declared before the use
+    auto found = index_.elements.find(href);
 
-    // Group
-    if (elemName == "g") {
-        // Create List of Children
-        vector<SVGElement *> children;
+    // Create Use Element, sharing the referenced element
+    UseElement *useEP = document_.arena().create<UseElement>(
+        document_.arena(), id, t, found != index_.elements.end() ? found->second : nullptr
+    );
 
-        // Get FirstChild
-        const XMLElement *child = element->FirstChildElement();
+    // Otherwise the element may come later in the document
+    if (!useEP->ref()) index_.pending.push_back({ useEP, href });
+    return useEP;
+}
 
-        // Loop Through Children
-        for (; child != nullptr; child = child->NextSiblingElement())
-            parseElement(child, children, elementListID, elemTransformList); // Parse Child
+void DocumentBuilder::end() {
+    depth_--;
+    if (skip_) {
+        skip_--;
+        return;
+    }
+    if (depth_ == 0) return; // End of the root
+
+    // End of a Group: Create Element with its Children
+    Arena      &arena = document_.arena();
+    OpenGroup  &group = groups_.back();
+    SVGElement *eP    = arena.create<GroupElement>(
+        arena, group.id, group.transform, children_.data() + group.first, children_.size() - group.first
+    );
+    children_.resize(group.first);
+    const string id = group.id;
+    groups_.pop_back();
+
+    add(eP, id);
+}
 
-        // Create Element
-        eP = new GroupElement(id, elemTransformList, children);
+void DocumentBuilder::add(SVGElement *eP, const string &id) {
+    // If Element has an ID add it to the Index of elements who have an ID
+    if (id.size()) index_.elements[id] = eP;
+
+    // Add Element to the List of its Group, or of the document
+    if (groups_.empty()) {
+        document_.elements().push_back(eP);
+    } else {
+        children_.push_back(eP);
     }
+}
 
-    // Use
-    if (elemName == "use") {
-        // Get href ignoring "#" caracter
-        string href(element->Attribute("href") + 1);
+void DocumentBuilder::finish() {
+    // Uses of elements declared after them
+    resolveReferences(index_, document_.elements());
 
-        // Create Copy Element Pointer
-        SVGElement *copyEP;
+    // The document keeps the index for lookups by ID
+    document_.ids().swap(index_.elements);
+}
+
+/// @brief              Drop the references that close a cycle, with a depth first search
+///                     over children and references. Each element is searched once.
+/// @param element      Element to search from
+/// @param visiting     Elements on the current path (true) or already searched (false)
+static void breakCycles(const SVGElement *element, unordered_map<const SVGElement *, bool> &visiting) {
+    if (visiting.count(element)) return; // Searched, or on the path (handled by the caller)
+    visiting[element] = true;
+
+    if (const GroupElement *group = dynamic_cast<const GroupElement *>(element)) {
+        for (size_t i = 0; i < group->size(); i++) breakCycles(group->child(i), visiting);
+    } else if (const UseElement *use = dynamic_cast<const UseElement *>(element)) {
+        auto ref = use->ref() ? visiting.find(use->ref()) : visiting.end();
+        if (ref != visiting.end() && ref->second) {
+            // The use would contain itself. Elements are never const in a document.
+            const_cast<UseElement *>(use)->setRef(nullptr);
+        } else if (use->ref()) {
+            breakCycles(use->ref(), visiting);
+        }
+    }
+    visiting[element] = false;
+}
 
-        // Find Matching Element
-        for (SVGElement *idElem : elementListID)
-            if (idElem->getID() == href)
-                copyEP = idElem->copy(elemTransformList); // Make a Copy of the element with extra Transformation
+void resolveReferences(IdIndex &index, const vector<SVGElement *> &elements) {
+    if (index.pending.empty()) return;
 
-        // Create Use Element
-        if (copyEP) eP = new UseElement(id, elemTransformList, copyEP);
+    for (const pair<UseElement *, string> &use : index.pending) {
+        auto found = index.elements.find(use.second);
+        if (found != index.elements.end()) use.first->setRef(found->second);
     }
+    index.pending.clear();
 
-    // Return if no element was created
-    if (!eP) return;
+    // Only references to later elements can form cycles, e.g. a use referencing its own group
+    unordered_map<const SVGElement *, bool> visiting;
+    for (const SVGElement *element : elements) breakCycles(element, visiting);
 
-    // If Element has an ID add it to the List with elements who have an ID
-    if (id.size()) elementListID.push_back(eP);
+    // Groups and uses built before the references were resolved cached incomplete bounds
+    updateBounds(elements);
+}
 
-    // Add Element to List
-    elementList.push_back(eP);
+Transform getTransform(const Attributes &attributes) {
+    return parseTransform(attributes.get("transform"), attributes.get("transform-origin"));
 }
 
-Transform getTransform(const XMLElement *element) {
+Transform parseTransform(const char *transform, const char *origin) {
     // Init values
-    const char *p;
-    int         translateX = 0;
-    int         translateY = 0;
-    int         scale      = 1;
-    int         rotate     = 0;
-    int         originX    = 0;
-    int         originY    = 0;
-
-    // Get Transformation Attribute String
-    p             = element->Attribute("transform");
-    string traStr = p ? p : "a"; // "a" because later First caracter of string will be read
-
-    // Substitute possible ',' for ' ' (spaces)
-    for (auto itr = traStr.begin(); itr != traStr.end(); ++itr)
-        if (*itr == ',') *itr = ' ';
-
-    // Create sStream from substring inside Parenthesis
-    size_t        start = traStr.find_first_of('(') + 1; // Will become Zero if not found
-    size_t        end   = traStr.find_first_of(')');
-    istringstream traStream(start ? traStr.substr(start, end - start) : "");
+    int translateX = 0;
+    int translateY = 0;
+    int scale      = 1;
+    int rotate     = 0;
+    int originX    = 0;
+    int originY    = 0;
+
+    // Values are inside Parenthesis, separated by commas or spaces
+    const char *values = transform ? ::strchr(transform, '(') : nullptr;
 
     // Parse Values According to Type of Transformation
-    switch (traStr[0]) {
-    case 't': // Translate
-        traStream >> translateX;
-        traStream >> translateY;
-        break;
-    case 'r': // Rotate
-        traStream >> rotate;
-        break;
-    case 's': // Scale
-        traStream >> scale;
-        break;
-    default: break;
+    if (values) {
+        values++;
+        switch (transform[0]) {
+        case 't': // Translate
+            if ((values = readInt(values, translateX, true))) readInt(values, translateY, true);
+            break;
+        case 'r': // Rotate
+            readInt(values, rotate, true);
+            break;
+        case 's': // Scale
+            readInt(values, scale, true);
+            break;
+        default: break;
+        }
     }
 
-    // Get Element Transformation Origin
-    p                      = element->Attribute("transform-origin");
-    const string originStr = p ? p : "";
-
-    // Parse Origin
-    if (originStr.size()) {
-        istringstream originStream(originStr);
-        originStream >> originX;
-        originStream >> originY;
-    }
+    // Parse Element Transformation Origin
+    if (origin && (origin = readInt(origin, originX, false))) readInt(origin, originY, false);
 
     return Transform(translateX, translateY, rotate, scale, originX, originY);
 }
 
+void parsePoints(const char *str, PointArray &points) {
+    points.x.clear();
+    points.y.clear();
+    if (!str) return;
+
+    // Pairs of integers, a last value without pair is dropped
+    int x, y;
+    while ((str = readInt(str, x, true)) && (str = readInt(str, y, true))) {
+        points.x.push_back(x);
+        points.y.push_back(y);
+    }
+}
+
 
 } // namespace svg
\ No newline at end of file
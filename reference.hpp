@@ -0,0 +1,149 @@
+// Simple implementations of what the library does faster, shared by the
+// tests, which check that both give the same results, and the benchmarks,
+// which time them, and helpers building their inputs.
+#ifndef __svg_reference_hpp__
+#define __svg_reference_hpp__
+
+// Project file headers
+#include "Color.hpp"
+#include "PNGImage.hpp"
+#include "Transform.hpp"
+
+// C++ library headers
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace svg {
+// Scanline fill that walks every edge and sorts the intersections on each
+// row, as draw_polygon did before the active edge table.
+inline void reference_draw_polygon(PNGImage &img, const std::vector<Point> &points, const Color &c) {
+    int y_min = img.height(), y_max = 0;
+    for (const Point &p : points) {
+        y_min = std::min(y_min, p.y);
+        y_max = std::max(y_max, p.y);
+    }
+    std::vector<double> seg;
+    for (int y = y_min; y < y_max; y++) {
+        for (size_t i = 0; i < points.size(); i++) {
+            Point a = points[i];
+            Point b = points[(i + 1) % points.size()];
+            if (y < std::min(a.y, b.y) || y > std::max(a.y, b.y)) { continue; }
+            if (a.y != b.y) {
+                seg.push_back((double)(y - a.y) * (b.x - a.x) / (double)(b.y - a.y) + a.x);
+            }
+        }
+        std::sort(seg.begin(), seg.end());
+        size_t i_s = 0;
+        while ((i_s + 1) < seg.size()) {
+            Point a = { (int)std::round(seg.at(i_s)), y };
+            Point b = { (int)std::round(seg.at(i_s + 1)), y };
+            if (a.x == b.x) {
+                i_s++;
+            } else {
+                img.draw_line(a, b, c);
+                i_s += 2;
+            }
+        }
+        seg.clear();
+    }
+    for (size_t i = 0; i < points.size(); i++) img.draw_line(points[i], points[(i + 1) % points.size()], c);
+}
+
+// Star polygon with n vertices alternating between two radii,
+// concave for n > 4.
+inline std::vector<Point> star(int n, const Point &center, int r_outer, int r_inner) {
+    std::vector<Point> points;
+    for (int i = 0; i < n; i++) {
+        double angle = 2 * M_PI * i / n;
+        int    r     = i % 2 ? r_inner : r_outer;
+        points.push_back(
+            { center.x + (int)std::lround(r * std::cos(angle)), center.y + (int)std::lround(r * std::sin(angle)) }
+        );
+    }
+    return points;
+}
+
+// Links of a chain applying the transformations in order; the last link is the
+// whole chain. The vector keeps its buffer when moved, so links stay valid.
+inline std::vector<TransformChain> chain_links(const std::vector<Transform> &t, TransformMode mode) {
+    std::vector<TransformChain> links;
+    links.reserve(t.size() + 1);
+    links.push_back(TransformChain(mode));
+    for (size_t i = t.size(); i-- > 0;) links.push_back(TransformChain(t[i], links.back()));
+    return links;
+}
+
+// Attribute parsers as they were before the non-allocating ones, with string
+// streams, which store the nearest int when a number overflows.
+inline void reference_parse_points(const char *str, std::vector<Point> &points) {
+    std::string pStr(str);
+    for (auto itr = pStr.begin(); itr != pStr.end(); ++itr)
+        if (*itr == ',') *itr = ' ';
+    std::istringstream issPoints(pStr);
+    int                x, y;
+    while (issPoints >> x >> y) points.push_back({ x, y });
+}
+
+inline Transform reference_parse_transform(const char *p) {
+    int         translateX = 0, translateY = 0, scale = 1, rotate = 0;
+    std::string traStr = p ? p : "a";
+    for (auto itr = traStr.begin(); itr != traStr.end(); ++itr)
+        if (*itr == ',') *itr = ' ';
+    size_t             start = traStr.find_first_of('(') + 1;
+    size_t             end   = traStr.find_first_of(')');
+    std::istringstream traStream(start ? traStr.substr(start, end - start) : "");
+    switch (traStr[0]) {
+    case 't': traStream >> translateX >> translateY; break;
+    case 'r': traStream >> rotate; break;
+    case 's': traStream >> scale; break;
+    default: break;
+    }
+    return Transform(translateX, translateY, rotate, scale, 0, 0);
+}
+
+inline Color reference_parse_color(const std::string &str) {
+    static const std::map<std::string, Color> names = {
+        { "black", { 0, 0, 0 } }, { "white", { 255, 255, 255 } }, { "red", { 255, 0, 0 } },
+    };
+    Color c;
+    if (str.at(0) == '#') {
+        int                v;
+        std::istringstream ss(str.substr(1));
+        ss >> std::hex >> v;
+        c.red   = (v >> 16);
+        c.green = (v >> 8) & 0xFF;
+        c.blue  = v & 0xFF;
+    } else {
+        c = names.at(str);
+    }
+    return c;
+}
+
+// Bresenham walk over every step of the line, as draw_line did before clipping
+inline void reference_draw_line(PNGImage &img, const Point &a, const Point &b, const Color &c) {
+    int dx = std::abs(b.x - a.x) * 2, dy = std::abs(b.y - a.y) * 2;
+    int sx = b.x < a.x ? -1 : 1, sy = b.y < a.y ? -1 : 1;
+    int x = a.x, y = a.y;
+    auto plot = [&]() {
+        if (x >= 0 && x < img.width() && y >= 0 && y < img.height()) img.at(x, y) = c;
+    };
+    plot();
+    if (dx > dy) {
+        for (int f = dy - dx / 2; x != b.x; f += dy, plot()) {
+            if (f >= 0) y += sy, f -= dx;
+            x += sx;
+        }
+    } else {
+        for (int f = dx - dy / 2; y != b.y; f += dx, plot()) {
+            if (f >= 0) x += sx, f -= dy;
+            y += sy;
+        }
+    }
+}
+} // namespace svg
+#endif
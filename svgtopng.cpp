@@ -1,13 +1,197 @@
 #include "SVGElements.hpp"
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// POSIX headers
+#include <dirent.h>
+
+// Input and output file of a conversion
+typedef std::pair<std::string, std::string> Job;
+
+// Output file for an input file, placed in out_dir
+static std::string output_for(const std::string &svg_file, const std::string &out_dir, const char *extension) {
+    std::string name = svg_file.substr(svg_file.find_last_of('/') + 1);
+    return out_dir + "/" + name.substr(0, name.find_last_of('.')) + extension;
+}
+
+// Read the jobs of a batch. The source is either a directory, whose svg files
+// are all converted, or a manifest file with one "in_file.svg [out_file.png]"
+// entry per line. Outputs not named go to out_dir, with the given extension.
+static bool read_jobs(
+    const std::string &source, const std::string &out_dir, const char *extension, std::vector<Job> &jobs
+) {
+    if (::DIR *directory = ::opendir(source.c_str())) {
+        ::dirent *entry;
+        while ((entry = ::readdir(directory)) != nullptr) {
+            std::string fname = entry->d_name;
+            if (fname.size() > 4 && fname.compare(fname.size() - 4, 4, ".svg") == 0) {
+                jobs.push_back(Job(source + "/" + fname, output_for(fname, out_dir, extension)));
+            }
+        }
+        ::closedir(directory);
+        return true;
+    }
+    std::ifstream manifest(source);
+    if (!manifest) { return false; }
+    std::string line;
+    while (std::getline(manifest, line)) {
+        std::istringstream entry(line);
+        std::string        svg_file, png_file;
+        if (!(entry >> svg_file) || svg_file[0] == '#') { continue; }
+        if (!(entry >> png_file)) { png_file = output_for(svg_file, out_dir, extension); }
+        jobs.push_back(Job(svg_file, png_file));
+    }
+    return true;
+}
+
+// Convert (or compile) all jobs on a pool of workers, each one with its own
+// converter. Failures are reported and the batch goes on.
+static int run_batch(
+    const std::vector<Job> &jobs, unsigned workers, const svg::ConvertOptions &options, bool compile
+) {
+    std::atomic<size_t> next(0);
+    std::atomic<int>    failed(0);
+    std::atomic<size_t> culled(0);
+    std::mutex          report;
+    auto                worker = [&]() {
+        svg::Converter converter(options);
+        for (size_t i = next++; i < jobs.size(); i = next++) {
+            try {
+                if (compile) {
+                    converter.compile(jobs[i].first, jobs[i].second);
+                } else {
+                    converter.convert(jobs[i].first, jobs[i].second);
+                    culled += converter.culled();
+                    if (options.stats) {
+                        std::lock_guard<std::mutex> lock(report);
+                        std::cout << "{\"file\": \"" << jobs[i].first << "\", \"stats\": " << converter.stats().json()
+                                  << "}" << std::endl;
+                    }
+                }
+            } catch (const std::exception &e) {
+                failed++;
+                std::lock_guard<std::mutex> lock(report);
+                std::cerr << "Failed: " << jobs[i].first << ": " << e.what() << std::endl;
+            }
+        }
+    };
+
+    if (workers == 0) { workers = std::max(1u, std::thread::hardware_concurrency()); }
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < workers; t++) pool.emplace_back(worker);
+    worker();
+    for (std::thread &t : pool) t.join();
+
+    std::cout << "Converted " << jobs.size() - failed << " of " << jobs.size() << " files." << std::endl;
+    if (options.occlusionCulling) { std::cout << "Culled " << culled << " occluded elements." << std::endl; }
+    return failed ? 1 : 0;
+}
+
+// Parse the value of a count option, which must be a whole non negative number
+static bool parse_count(const char *text, int &value) {
+    char *end;
+    errno  = 0;
+    long n = ::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || n < 0 || n > INT_MAX) { return false; }
+    value = (int)n;
+    return true;
+}
+
+static void print_usage() {
+    std::cout << "Usage: svgtopng [options] (in_file.svg | in_file.svgdl) out_file.png" << std::endl
+              << "       svgtopng --compile [options] in_file.svg out_file.svgdl" << std::endl
+              << "       svgtopng --batch [--jobs=N] [--compile] [options] (manifest | svg_dir) out_dir" << std::endl
+              << "Options: --tile=N --threads=N --fast-transforms --cull-occluded --stats=json" << std::endl
+              << "         --png-level=0..9 --png-filter=(none|sub|up|average|paeth|adaptive) --overdraw"
+              << std::endl
+              << "         --format=(rgb|rgba|gray)" << std::endl;
+}
 
 int main(int argc, char **argv) {
-    if (argc != 3) {
-        std::cout << "Usage: svgtopng in_file.svg out_file.png" << std::endl;
+    svg::ConvertOptions options;
+    bool                batch   = false;
+    bool                compile = false;
+    int                 jobs    = 0;
+    int                 threads = 0;
+    int                 arg     = 1;
+    std::string         error; // Of an option with an invalid value
+    for (; arg < argc && ::strncmp(argv[arg], "--", 2) == 0 && error.empty(); arg++) {
+        if (::strncmp(argv[arg], "--tile=", 7) == 0) {
+            if (!parse_count(argv[arg] + 7, options.tileSize)) { error = std::string("Invalid ") + argv[arg]; }
+        } else if (::strncmp(argv[arg], "--threads=", 10) == 0) {
+            if (!parse_count(argv[arg] + 10, threads)) { error = std::string("Invalid ") + argv[arg]; }
+            options.threads     = threads;
+            options.png.threads = options.threads;
+        } else if (::strncmp(argv[arg], "--png-level=", 12) == 0) {
+            if (!parse_count(argv[arg] + 12, options.png.level) || options.png.level > 9) {
+                error = std::string("Invalid ") + argv[arg] + ", the level goes from 0 to 9";
+            }
+        } else if (::strncmp(argv[arg], "--png-filter=", 13) == 0) {
+            try {
+                options.png.filter = svg::parse_png_filter(argv[arg] + 13);
+            } catch (const std::invalid_argument &e) { error = e.what(); }
+        } else if (::strcmp(argv[arg], "--fast-transforms") == 0) {
+            options.transformMode = svg::TransformMode::Fast;
+        } else if (::strcmp(argv[arg], "--cull-occluded") == 0) {
+            options.occlusionCulling = true;
+        } else if (::strcmp(argv[arg], "--compile") == 0) {
+            compile = true;
+        } else if (::strcmp(argv[arg], "--batch") == 0) {
+            batch = true;
+        } else if (::strncmp(argv[arg], "--jobs=", 7) == 0) {
+            if (!parse_count(argv[arg] + 7, jobs)) { error = std::string("Invalid ") + argv[arg]; }
+        } else if (::strcmp(argv[arg], "--stats=json") == 0) {
+            options.stats = true;
+        } else if (::strcmp(argv[arg], "--overdraw") == 0) {
+            options.overdraw = true;
+        } else if (::strncmp(argv[arg], "--format=", 9) == 0) {
+            try {
+                options.pixelFormat = svg::parse_pixel_format(argv[arg] + 9);
+            } catch (const std::invalid_argument &e) { error = e.what(); }
+        } else {
+            break;
+        }
+    }
+    if (!error.empty()) {
+        std::cerr << error << std::endl;
+        print_usage();
+        return 1;
+    }
+    if (argc - arg != 2) {
+        print_usage();
+    } else if (batch) {
+        std::vector<Job> batch_jobs;
+        if (!read_jobs(argv[arg], argv[arg + 1], compile ? ".svgdl" : ".png", batch_jobs)) {
+            std::cerr << "Unable to read " << argv[arg] << std::endl;
+            return 1;
+        }
+        return run_batch(batch_jobs, jobs, options, compile);
     } else {
-        std::cout << "Performing conversion ... " << argv[1] << " --> "
-                  << argv[2] << std::endl;
-        svg::convert(argv[1], argv[2]);
+        std::cout << "Performing conversion ... " << argv[arg] << " --> "
+                  << argv[arg + 1] << std::endl;
+        if (compile) {
+            svg::Converter(options).compile(argv[arg], argv[arg + 1]);
+        } else {
+            svg::Converter converter(options);
+            converter.convert(argv[arg], argv[arg + 1]);
+            if (options.occlusionCulling) {
+                std::cout << "Culled " << converter.culled() << " occluded elements." << std::endl;
+            }
+            if (options.stats) { std::cout << converter.stats().json() << std::endl; }
+        }
         std::cout << "Done!" << std::endl;
     }
     return 0;
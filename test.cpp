@@ -1,16 +1,26 @@
 
 // Project file headers
+#include "DisplayList.hpp"
 #include "SVGElements.hpp"
+#include "Scene.hpp"
+#include "reference.hpp"
 
 // C++ library headers
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
@@ -21,7 +31,8 @@ using namespace std;
 #include <unistd.h>
 
 namespace svg {
-const string LOG_FILE_NAME = "test_log.txt";
+const string LOG_FILE_NAME      = "test_log.txt";
+const string MANIFEST_FILE_NAME = "manifest.txt";
 
 class TestDriver {
   private:
@@ -31,28 +42,403 @@ class TestDriver {
     int    failed_tests = 0;
     FILE  *log_stream;
 
+    // Golden hashes of the expected images, by test id, so they need not be decoded
+    unordered_map<string, uint64_t> manifest;
+
+    string manifest_file() const { return root_path + "/expected/" + MANIFEST_FILE_NAME; }
+
+    // FNV-1a hash of the dimensions and pixels of an image
+    static uint64_t image_hash(const PNGImage &img) {
+        uint64_t hash = 0xcbf29ce484222325;
+        auto     add  = [&](const unsigned char *bytes, size_t n) {
+            for (size_t i = 0; i < n; i++) hash = (hash ^ bytes[i]) * 0x100000001b3;
+        };
+        int dimensions[2] = { img.width(), img.height() };
+        add((const unsigned char *)dimensions, sizeof(dimensions));
+        for (int y = 0; y < img.height(); y++) {
+            add((const unsigned char *)img.row(y), img.width() * sizeof(Color));
+        }
+        return hash;
+    }
+
+    // Compare the images a row at a time; on a mismatch report the
+    // mismatched pixels and their bounding box, and write a diff image
+    // where they are red over a faded copy of the expected image.
+    bool compare_images(const PNGImage &expected, const PNGImage &actual, const string &diff_file) {
+        int w = expected.width(), h = expected.height();
+        if (w != actual.width() || h != actual.height()) {
+            cout << "Images have different dimensions: " << w << "x" << h << " != " << actual.width() << "x"
+                 << actual.height() << endl;
+            return false;
+        }
+        const size_t row_bytes  = w * sizeof(Color);
+        size_t       mismatches = 0;
+        Box          box        = Box::empty();
+        for (int y = 0; y < h; y++) {
+            if (::memcmp(expected.row(y), actual.row(y), row_bytes) == 0) { continue; }
+            for (int x = 0; x < w; x++) {
+                if (::memcmp(&expected.row(y)[x], &actual.row(y)[x], sizeof(Color)) != 0) {
+                    mismatches++;
+                    box = box.extend({ x, y });
+                }
+            }
+        }
+        if (mismatches == 0) { return true; }
+
+        PNGImage diff(w, h);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                Color c1 = expected.row(y)[x], c2 = actual.row(y)[x];
+                if (c1.red != c2.red || c1.green != c2.green || c1.blue != c2.blue) {
+                    diff.at(x, y) = { 255, 0, 0 };
+                } else {
+                    diff.at(x, y) = { (rgb_value)(191 + c1.red / 4), (rgb_value)(191 + c1.green / 4),
+                                      (rgb_value)(191 + c1.blue / 4) };
+                }
+            }
+        }
+        diff.save(diff_file);
+        cout << mismatches << " pixels differ, in (" << box.min.x << ' ' << box.min.y << ")-(" << box.max.x << ' '
+             << box.max.y << "), see " << diff_file << endl;
+        return false;
+    }
+
+    // Check that a grey image is the luma of a color image, pixel by pixel
+    static bool same_luma(const PNGImage &color, const PNGImageGray &gray) {
+        if (color.width() != gray.width() || color.height() != gray.height()) {
+            cout << "Grey image has different dimensions (Gray8 rendering)" << endl;
+            return false;
+        }
+        for (int y = 0; y < color.height(); y++) {
+            for (int x = 0; x < color.width(); x++) {
+                if (gray.at(x, y) != Gray8::pack(color.at(x, y))) {
+                    cout << "Pixel (" << x << ' ' << y << ") is not the luma of the image (Gray8 rendering)" << endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
     bool run_conversion_test(const string &id) {
         string svg_file = root_path + "/input/" + id + ".svg";
         string exp_file = root_path + "/expected/" + id + ".png";
         string out_file = root_path + "/output/" + id + ".png";
-        convert(svg_file, out_file);
-        PNGImage img1(exp_file), img2(out_file);
-        int      w1 = img1.width(), h1 = img1.height(), w2 = img2.width(),
-            h2 = img2.height();
-        if (w1 != w2 || h1 != h2) {
-            std::cout << "Images have different dimensions: " << w1 << "x" << h1
-                      << " != " << w2 << "x" << h2 << endl;
+
+        // Every rendering is compared in memory with the golden hash from the
+        // manifest, or with the expected image, decoded only when needed.
+        unique_ptr<PNGImage> expected;
+        auto                 golden = manifest.find(id);
+        auto                 check  = [&](const PNGImage &img, const string &suffix, const string &rendering) {
+            if (golden != manifest.end() && image_hash(img) == golden->second) { return true; }
+            if (golden != manifest.end()) {
+                cout << "Image hash differs from " << MANIFEST_FILE_NAME << " (" << rendering << ")" << endl;
+            }
+            if (!expected) { expected.reset(new PNGImage(exp_file)); }
+            if (compare_images(*expected, img, root_path + "/output/" + id + suffix + "_diff.png")) {
+                if (golden == manifest.end()) { return true; }
+                cout << "Image matches " << exp_file << ", " << MANIFEST_FILE_NAME << " is out of date" << endl;
+                return false;
+            }
+            cout << "(" << rendering << ")" << endl;
+            return false;
+        };
+
+        // The output file is written for inspection, through the file API
+        Converter converter;
+        converter.convert(svg_file, out_file);
+        if (!check(converter.image(), "", "serial rendering")) { return false; }
+
+        // Tiled rendering must give the same image, small tiles
+        // make sure elements crossing tile borders are exercised.
+        ifstream       svg_in(svg_file, ios::binary);
+        string         svg((istreambuf_iterator<char>(svg_in)), istreambuf_iterator<char>());
+        ConvertOptions tiled;
+        tiled.tileSize = 16;
+        tiled.threads  = 4;
+        if (!check(Converter(tiled).render(svg.data(), svg.size()), "_tiled", "tiled rendering")) { return false; }
+
+        // And leaving out the elements painted over by later ones
+        ConvertOptions culled;
+        culled.occlusionCulling = true;
+        if (!check(Converter(culled).render(svg.data(), svg.size()), "_culled", "occlusion culling")) { return false; }
+
+        // So must the compiled display list, rendered from the mapped file
+        string dl_file     = root_path + "/output/" + id + ".svgdl";
+        string dl_png_file = root_path + "/output/" + id + "_dl.png";
+        converter.compile(svg_file, dl_file);
+        converter.convert(dl_file, dl_png_file);
+        if (!check(converter.image(), "_dl", "display list")) { return false; }
+
+        // And rendering the text in memory to PNG bytes, decoded back
+        vector<unsigned char> png;
+        converter.renderPNG(svg.data(), svg.size(), png);
+        if (!check(PNGImage(png.data(), png.size()), "_memory", "in-memory rendering")) { return false; }
+
+        // The other pixel formats: RGBA is saved without alpha, so it gives the same
+        // image, and grey must be the luma of the image as stb_image computes it
+        ConvertOptions rgba;
+        rgba.pixelFormat = PixelFormat::RGBA8888;
+        string rgba_file = root_path + "/output/" + id + "_rgba.png";
+        Converter(rgba).convert(svg_file, rgba_file);
+        if (!check(PNGImage(rgba_file), "_rgba", "RGBA8888 rendering")) { return false; }
+        rgba.occlusionCulling = true;
+        Converter(rgba).convert(svg_file, rgba_file);
+        if (!check(PNGImage(rgba_file), "_rgba_culled", "RGBA8888 rendering, occlusion culling")) { return false; }
+        ConvertOptions gray;
+        gray.pixelFormat = PixelFormat::Gray8;
+        gray.tileSize    = 16;
+        string gray_file = root_path + "/output/" + id + "_gray.png";
+        Converter(gray).convert(svg_file, gray_file);
+        return same_luma(converter.image(), PNGImageGray(gray_file));
+    }
+
+    // Ids of the input files starting with a spec, sorted
+    bool input_ids(const string &spec, vector<string> &ids) const {
+        string dir_path  = root_path + "/input";
+        ::DIR *directory = ::opendir(dir_path.c_str());
+        if (directory == nullptr) {
+            cerr << "Unable to open input directory " << dir_path << endl;
+            return false;
+        }
+        ::dirent *entry;
+        while ((entry = readdir(directory)) != nullptr) {
+            if (entry->d_type == DT_REG) {
+                string fname = entry->d_name;
+                if (fname.find(spec) == 0) { ids.push_back(fname.substr(0, fname.find_last_of('.'))); }
+            }
+        }
+        ::closedir(directory);
+        sort(ids.begin(), ids.end());
+        return true;
+    }
+
+    // Each change made through a Scene must leave the image a full redraw of the changed document gives
+    bool test_scene() {
+        Scene scene(root_path + "/input/scene_1.svg");
+        int   step  = 0;
+        auto  check = [&](const string &change) {
+            const Document &doc = scene.document();
+            PNGImage        redraw(doc.dimensions().x, doc.dimensions().y);
+            TransformChain  root;
+            for (const SVGElement *element : doc.elements()) element->draw(redraw, root);
+            string diff_file = root_path + "/output/scene_" + to_string(++step) + "_diff.png";
+            if (compare_images(redraw, scene.image(), diff_file)) { return true; }
+            cout << "(Scene::" << change << ")" << endl;
+            return false;
+        };
+
+        // A circle
+        scene.setColor("sun", { 255, 0, 0 });
+        if (!check("setColor of a circle")) { return false; }
+        scene.setTransform("sun", Transform(150, 20, 0, 1, 0, 0));
+        if (!check("setTransform of a circle")) { return false; }
+
+        // A polyline, with fewer points, then more than it had
+        scene.setPoints("path", { { 10, 10 }, { 230, 230 } });
+        if (!check("setPoints of a polyline, fewer points")) { return false; }
+        scene.setPoints("path", { { 5, 120 }, { 40, 90 }, { 80, 130 }, { 120, 60 }, { 160, 120 }, { 235, 5 } });
+        if (!check("setPoints of a polyline, more points")) { return false; }
+        scene.setColor("path", { 0, 128, 0 });
+        if (!check("setColor of a polyline")) { return false; }
+
+        // A grouped child, then the group
+        scene.setColor("wall", { 0, 0, 255 });
+        if (!check("setColor of a grouped child")) { return false; }
+        scene.setPoints("roof", { { 0, 30 }, { 40, -20 }, { 80, 30 } });
+        if (!check("setPoints of a grouped child")) { return false; }
+        scene.setTransform("wall", Transform(10, 0, 0, 1, 0, 0));
+        if (!check("setTransform of a grouped child")) { return false; }
+        scene.setTransform("house", Transform(20, 120, 15, 1, 40, 45));
+        if (!check("setTransform of a group")) { return false; }
+
+        // The target of two uses, drawn three times
+        scene.setColor("star", { 128, 0, 128 });
+        if (!check("setColor of a use target")) { return false; }
+        scene.setPoints("star", { { 0, 0 }, { 30, 5 }, { 10, 30 } });
+        if (!check("setPoints of a use target")) { return false; }
+        scene.setTransform("star", Transform(0, 0, 0, 2, 0, 0));
+        return check("setTransform of a use target");
+    }
+
+    // The active edge table must fill the pixels the per-row edge walk did,
+    // for convex and concave polygons
+    bool test_draw_polygon() {
+        const Color color = { 0, 0, 255 };
+        for (int n : { 3, 4, 5, 16, 64, 256, 1024 }) {
+            vector<Point> points = star(n, { 128, 128 }, 120, 60);
+            PNGImage      img(256, 256), ref(256, 256);
+            img.draw_polygon(points, color);
+            reference_draw_polygon(ref, points, color);
+            string diff_file = root_path + "/output/draw_polygon_" + to_string(n) + "_diff.png";
+            if (!compare_images(ref, img, diff_file)) {
+                cout << "(draw_polygon, star of " << n << " vertices)" << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The batch kernel must map every point where applying the chain to it alone does,
+    // whatever the number of points left after the last full batch
+    bool test_transform_batch() {
+        vector<Transform> t = { Transform(3, -7, 30, 2, 100, 50), Transform(0, 0, 0, 3, -20, 10),
+                                Transform(11, 5, -45, 1, 0, 0) };
+        for (TransformMode mode : { TransformMode::Exact, TransformMode::Fast }) {
+            vector<TransformChain> links = chain_links(t, mode);
+            const TransformChain  &chain = links.back();
+            for (int n : { 0, 1, 3, 7, 8, 9, 1000 }) {
+                PointArray in, out;
+                for (int i = 0; i < n; i++) {
+                    in.x.push_back(rand() % 20001 - 10000);
+                    in.y.push_back(rand() % 20001 - 10000);
+                }
+                chain.apply(in, out);
+                if (out.size() != in.size()) {
+                    cout << "Batch of " << n << " points gave " << out.size() << " points" << endl;
+                    return false;
+                }
+                for (int i = 0; i < n; i++) {
+                    Point single = chain.apply(in.at(i));
+                    if (single.x != out.x[i] || single.y != out.y[i]) {
+                        cout << "Point " << i << " of " << n << " is (" << out.x[i] << ' ' << out.y[i]
+                             << ") in the batch, (" << single.x << ' ' << single.y << ") alone ("
+                             << (mode == TransformMode::Exact ? "exact" : "fast") << " mode)" << endl;
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Skipping the subtrees outside the canvas must draw what walking every element
+    // does, and clipped lines the pixels of the whole Bresenham walk
+    bool test_culling() {
+        // 50 x 50 cells of 4 shapes, zoomed 8 times on a 256 x 256 canvas
+        const int n = 50;
+        string    svg = "<svg width=\"256\" height=\"256\"><g transform=\"scale(8)\">";
+        for (int i = 0; i < n * n; i++) {
+            string x = to_string(i % n * 10 - 20), y = to_string(i / n * 10 - 20);
+            string x2 = to_string(i % n * 10 - 11), y2 = to_string(i / n * 10 - 13);
+            svg += "<g><rect x=\"" + x + "\" y=\"" + y + "\" width=\"6\" height=\"6\" fill=\"red\"/><circle cx=\"" + x
+                   + "\" cy=\"" + y + "\" r=\"3\" fill=\"blue\"/><line x1=\"" + x + "\" y1=\"" + y + "\" x2=\"" + x2
+                   + "\" y2=\"" + y2 + "\" stroke=\"black\"/><polygon points=\"" + x + ',' + y2 + ' ' + x2 + ',' + y2
+                   + ' ' + x + ',' + y + "\" fill=\"green\"/></g>";
+        }
+        svg += "</g></svg>";
+        Document document;
+        readSVG(svg.data(), svg.size(), document);
+        const GroupElement *zoomed = dynamic_cast<const GroupElement *>(document.elements()[0]);
+        Transform           zoom(0, 0, 0, 8, 0, 0), none(0, 0, 0, 1, 0, 0);
+        TransformChain      root, chain(zoom, root), cell(none, chain);
+        PNGImage            reference(256, 256), culled(256, 256);
+        for (size_t i = 0; i < zoomed->size(); i++) {
+            const GroupElement *group = dynamic_cast<const GroupElement *>(zoomed->child(i));
+            for (size_t j = 0; j < group->size(); j++) group->child(j)->draw(reference, cell);
+        }
+        for (SVGElement *e : document.elements()) e->draw(culled, root);
+        if (!compare_images(reference, culled, root_path + "/output/culling_crop_diff.png")) {
+            cout << "(zoomed crop of a large document)" << endl;
+            return false;
+        }
+
+        // Lines through the canvas, and along its borders, from far outside of it
+        PNGImage walked(256, 256), clipped(256, 256);
+        for (int i = 0; i < 100; i++) {
+            Point from[3] = { { -100000 + i * 37, -80000 + i * 11 }, { -5000, i * 3 }, { i * 2, 300 } };
+            Point to[3]   = { { 100000 - i * 29, 90000 - i * 13 }, { 5000, 255 - i }, { 255 - i, -7000 - i } };
+            for (int j = 0; j < 3; j++) {
+                reference_draw_line(walked, from[j], to[j], Color{ 0, 0, 255 });
+                clipped.draw_line(from[j], to[j], Color{ 0, 0, 255 });
+            }
+        }
+        if (!compare_images(walked, clipped, root_path + "/output/culling_lines_diff.png")) {
+            cout << "(lines from outside the canvas)" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Rendering the text in memory must give the PNG file converting the svg file writes,
+    // byte for byte, for every input file
+    bool test_render_memory() {
+        vector<string> ids;
+        if (!input_ids("", ids)) { return false; }
+        Converter             converter;
+        vector<unsigned char> memory_png;
+        for (const string &id : ids) {
+            string   png_file = root_path + "/output/" + id + "_render_memory.png";
+            ifstream svg_in(root_path + "/input/" + id + ".svg", ios::binary);
+            string   text((istreambuf_iterator<char>(svg_in)), istreambuf_iterator<char>());
+            converter.convert(root_path + "/input/" + id + ".svg", png_file);
+            ifstream              png_in(png_file, ios::binary);
+            vector<unsigned char> file_png((istreambuf_iterator<char>(png_in)), istreambuf_iterator<char>());
+            converter.renderPNG(text.data(), text.size(), memory_png);
+            if (file_png != memory_png) {
+                cout << id << ": renderPNG gave " << memory_png.size() << " bytes, differing from the "
+                     << file_png.size() << " bytes of " << png_file << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Occlusion culling must leave out the layers painted over by an opaque
+    // background, and only them, without changing a pixel
+    bool test_occlusion() {
+        const int layers = 4;
+        string    svg    = "<svg width=\"256\" height=\"256\">";
+        for (int l = 0; l < layers; l++) {
+            svg += string("<g><rect x=\"0\" y=\"0\" width=\"256\" height=\"256\" fill=\"")
+                   + (l % 2 ? "white" : "red") + "\"/>";
+            for (int i = 0; i < 200; i++) {
+                string x = to_string(i * 37 % 250), y = to_string(i * 53 % 250);
+                string x2 = to_string(i * 37 % 250 + 30), y2 = to_string(i * 53 % 250 + 40);
+                svg += "<circle cx=\"" + x + "\" cy=\"" + y + "\" r=\"12\" fill=\"blue\"/><polyline points=\"" + x
+                       + ',' + y + ' ' + x2 + ',' + y + ' ' + x + ',' + y2 + "\" stroke=\"black\"/>";
+            }
+            svg += "</g>";
+        }
+        svg += "</svg>";
+        Document document;
+        readSVG(svg.data(), svg.size(), document);
+        PNGImage             all(256, 256), culled(256, 256);
+        vector<SVGElement *> visible;
+        size_t               count = cullOccluded(document.elements(), culled.region(), TransformMode::Exact, visible);
+        for (SVGElement *e : document.elements()) e->draw(all, TransformChain());
+        for (SVGElement *e : visible) e->draw(culled, TransformChain());
+        if (count != layers - 1 || visible.size() != 1 || visible[0] != document.elements().back()) {
+            cout << "Culled " << count << " of " << layers << " layers, only the last one should be left" << endl;
             return false;
         }
-        for (int i = 0; i < w1; i++) {
-            for (int j = 0; j < h1; j++) {
-                Color c1 = img1.at(i, j), c2 = img2.at(i, j);
-                if (c1.red != c2.red || c1.green != c2.green
-                    || c1.blue != c2.blue) {
-                    cout << "pixel (" << i << ' ' << j << "): expected "
-                         << (int)c1.red << ' ' << (int)c1.green << ' '
-                         << (int)c1.blue << " got " << (int)c2.red << ' '
-                         << (int)c2.green << ' ' << (int)c2.blue << std::endl;
+        if (!compare_images(all, culled, root_path + "/output/occlusion_layers_diff.png")) {
+            cout << "(occlusion culling of layers)" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // A display list compiled in memory must render the image drawing the document
+    // gives, in both transformation modes, for every input file
+    bool test_display_list() {
+        vector<string> ids;
+        if (!input_ids("", ids)) { return false; }
+        for (const string &id : ids) {
+            Document document;
+            readSVG(root_path + "/input/" + id + ".svg", document);
+            Point size = document.dimensions();
+            for (TransformMode mode : { TransformMode::Exact, TransformMode::Fast }) {
+                PNGImage       drawn(size.x, size.y), listed(size.x, size.y);
+                TransformChain root(mode);
+                for (SVGElement *e : document.elements()) e->draw(drawn, root);
+                vector<uint32_t> words;
+                compileDisplayList(document, words, mode);
+                DisplayList(words.data(), words.size() * sizeof(uint32_t)).render(listed);
+                const char *mode_name = mode == TransformMode::Exact ? "exact" : "fast";
+                string      diff_file = root_path + "/output/" + id + "_dl_" + mode_name + "_diff.png";
+                if (!compare_images(drawn, listed, diff_file)) {
+                    cout << "(" << id << ", display list in " << mode_name << " mode)" << endl;
                     return false;
                 }
             }
@@ -60,6 +446,130 @@ class TestDriver {
         return true;
     }
 
+    // The streaming reader, from the file and from memory, must build the tree the
+    // walk of a XML document does, which renders the same image, for every input file
+    bool test_read_svg() {
+        vector<string> ids;
+        if (!input_ids("", ids)) { return false; }
+        for (const string &id : ids) {
+            string   svg_file = root_path + "/input/" + id + ".svg";
+            ifstream in(svg_file, ios::binary);
+            string   text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+            tinyxml2::XMLDocument xml;
+            Document              dom, stream, memory;
+            readSVG(xml, svg_file, dom);
+            readSVG(svg_file, stream);
+            readSVG(text.data(), text.size(), memory);
+            PNGImage dom_img(dom.dimensions().x, dom.dimensions().y);
+            for (SVGElement *e : dom.elements()) e->draw(dom_img, TransformChain());
+            Document   *documents[2] = { &stream, &memory };
+            const char *readers[2]   = { "stream", "memory" };
+            for (int i = 0; i < 2; i++) {
+                if (documents[i]->elements().size() != dom.elements().size()
+                    || documents[i]->ids().size() != dom.ids().size()) {
+                    cout << id << ": " << readers[i] << " reader read " << documents[i]->elements().size()
+                         << " elements and " << documents[i]->ids().size() << " ids, the XML document "
+                         << dom.elements().size() << " and " << dom.ids().size() << endl;
+                    return false;
+                }
+                PNGImage img(documents[i]->dimensions().x, documents[i]->dimensions().y);
+                for (SVGElement *e : documents[i]->elements()) e->draw(img, TransformChain());
+                string diff_file = root_path + "/output/" + id + "_" + readers[i] + "_reader_diff.png";
+                if (!compare_images(dom_img, img, diff_file)) {
+                    cout << "(" << id << ", " << readers[i] << " reader)" << endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // The non-allocating attribute parsers must give what the string stream ones did,
+    // including the nearest int when a number overflows
+    bool test_parsers() {
+        vector<string> point_lists = { "", "1,2", "1 2 3 4", " 10,20  30 , 40 ", "-5,-6 7,-8", "1,2 3" };
+        for (int n : { 16, 4096 }) {
+            string str;
+            for (const Point &p : star(n, { 5000, 5000 }, 4000, 2000))
+                str += to_string(p.x) + (n % 3 ? "," : " ") + to_string(p.y) + " ";
+            point_lists.push_back(str);
+        }
+        for (const string &str : point_lists) {
+            vector<Point> expected;
+            PointArray    points;
+            reference_parse_points(str.c_str(), expected);
+            parsePoints(str.c_str(), points);
+            vector<Point> parsed = points.to_vector();
+            if (parsed.size() != expected.size()
+                || !equal(expected.begin(), expected.end(), parsed.begin(), [](const Point &a, const Point &b) {
+                       return a.x == b.x && a.y == b.y;
+                   })) {
+                cout << "parsePoints(\"" << str.substr(0, 40) << "\") differs from the string stream" << endl;
+                return false;
+            }
+        }
+
+        for (const char *str : { "translate(-120, 45)", "translate(7 -3)", "rotate(30)", "rotate(-45)", "scale(3)",
+                                 "translate(99999999999, 5)", "translate(5, -99999999999)", "scale(-3000000000)",
+                                 "rotate(2147483648)" }) {
+            Transform expected = reference_parse_transform(str), parsed = parseTransform(str, nullptr);
+            if (expected.getTrans().x != parsed.getTrans().x || expected.getTrans().y != parsed.getTrans().y
+                || expected.getRotate() != parsed.getRotate() || expected.getScale() != parsed.getScale()) {
+                cout << "parseTransform(\"" << str << "\") differs from the string stream" << endl;
+                return false;
+            }
+        }
+
+        // Integer attributes, such as dimensions and coordinates
+        for (const char *str : { "12", " -7", "+3", "12.5", "x", "99999999999", "-99999999999" }) {
+            Attributes attributes;
+            attributes.add("width", str);
+            istringstream stream(str);
+            int           expected = 0;
+            stream >> expected;
+            if (attributes.getInt("width") != expected) {
+                cout << "Attributes::getInt(\"" << str << "\") gives " << attributes.getInt("width")
+                     << ", the string stream " << expected << endl;
+                return false;
+            }
+        }
+
+        for (const char *str : { "#FADFAA", "#000000", "#ffffff", "#0A0b0C", "white", "black", "red" }) {
+            Color expected = reference_parse_color(str), parsed = parse_color(str);
+            if (expected.red != parsed.red || expected.green != parsed.green || expected.blue != parsed.blue) {
+                cout << "parse_color(\"" << str << "\") differs from the string stream" << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Tests of the library that do not convert an input file, selected by the
+    // same spec as the input files and run after them
+    typedef bool (TestDriver::*UnitTest)();
+    static const vector<pair<string, UnitTest>> &unit_tests() {
+        static const vector<pair<string, UnitTest>> tests = {
+            { "culling", &TestDriver::test_culling },
+            { "display_list", &TestDriver::test_display_list },
+            { "draw_polygon", &TestDriver::test_draw_polygon },
+            { "occlusion", &TestDriver::test_occlusion },
+            { "parsers", &TestDriver::test_parsers },
+            { "read_svg", &TestDriver::test_read_svg },
+            { "render_memory", &TestDriver::test_render_memory },
+            { "scene_updates", &TestDriver::test_scene },
+            { "transform_batch", &TestDriver::test_transform_batch },
+        };
+        return tests;
+    }
+
+    bool run_test(const string &id) {
+        for (const auto &test : unit_tests()) {
+            if (test.first == id) { return (this->*test.second)(); }
+        }
+        return run_conversion_test(id);
+    }
+
     void onTestBegin(const string &id) {
         total_tests++;
         fprintf(log_stream, ">>>> [%d] %s <<<<\n", total_tests, id.c_str());
@@ -77,65 +587,120 @@ class TestDriver {
         }
     }
 
-    void run_test(const string &id) {
-        int log_fd = ::fileno(log_stream);
-        onTestBegin(id);
+    // Start a test in a child process, whose output goes to its own log
+    ::pid_t start_test(const string &id, FILE *test_log) {
+        fflush(nullptr); // Or the child would write the pending output again
         ::pid_t pid = ::fork();
 
         if (pid == 0) {
-            ::dup2(log_fd, 1);
-            ::dup2(log_fd, 2);
-            bool success = run_conversion_test(id);
+            ::dup2(::fileno(test_log), 1);
+            ::dup2(::fileno(test_log), 2);
+            bool success = run_test(id);
             ::exit(success ? 0 : 1);
-        } else if (pid > 0) {
-            // parent process waits
-            int child_status = -1;
-            ::waitpid(pid, &child_status, 0);
-
-            bool success
-                = WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0;
-            onTestCompletion(success);
-        } else {
-            // pid < 0
+        } else if (pid < 0) {
             perror("Unable to run tests! Process creation failed!");
             ::exit(1);
         }
+        return pid;
+    }
+
+    // Report a finished test, appending its log as a section of the main log
+    void report_test(const string &id, FILE *test_log, int child_status) {
+        onTestBegin(id);
+        char   buffer[4096];
+        size_t n;
+        ::rewind(test_log);
+        while ((n = fread(buffer, 1, sizeof(buffer), test_log)) > 0) fwrite(buffer, 1, n, log_stream);
+        fclose(test_log);
+        fflush(log_stream);
+
+        bool success = WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0;
+        onTestCompletion(success);
+    }
+
+    // Run tests keeping up to jobs children at once, reporting them in order
+    void run_all(const vector<string> &ids, unsigned jobs) {
+        vector<FILE *>       logs(ids.size(), nullptr);
+        vector<int>          status(ids.size(), 0);
+        vector<bool>         done(ids.size(), false);
+        map<::pid_t, size_t> running; // Index of the test run by each child
+        size_t               started = 0, reported = 0;
+        while (reported < ids.size()) {
+            while (started < ids.size() && running.size() < jobs) {
+                logs[started] = ::tmpfile();
+                if (logs[started] == nullptr) {
+                    perror("Unable to run tests! Log creation failed!");
+                    ::exit(1);
+                }
+                running[start_test(ids[started], logs[started])] = started;
+                started++;
+            }
+
+            // parent process waits for any child
+            int     child_status = -1;
+            ::pid_t pid          = ::waitpid(-1, &child_status, 0);
+            auto    it           = running.find(pid);
+            if (it == running.end()) continue;
+            status[it->second] = child_status;
+            done[it->second]   = true;
+            running.erase(it);
+            for (; reported < ids.size() && done[reported]; reported++) {
+                report_test(ids[reported], logs[reported], status[reported]);
+            }
+        }
     }
 
   public:
     TestDriver(const string &root_path)
         : root_path(root_path),
-          log_stream(fopen((root_path + "/" + LOG_FILE_NAME).c_str(), "w")) {}
+          log_stream(fopen((root_path + "/" + LOG_FILE_NAME).c_str(), "w")) {
+        // Lines of the manifest: hash in hexadecimal, then test id
+        ifstream in(manifest_file());
+        string   hash, id;
+        while (in >> hash >> id) manifest[id] = stoull(hash, nullptr, 16);
+    }
 
-    void run_tests(const string &spec) {
-        string dir_path  = root_path + "/input";
-        ::DIR *directory = ::opendir(dir_path.c_str());
+    // Write the manifest with the hashes of all expected images
+    void write_manifest() {
+        ::DIR *directory = ::opendir((root_path + "/expected").c_str());
         if (directory == nullptr) {
-            cerr << "Unable to open input directory " << dir_path << endl;
-            return;
+            cerr << "Unable to open expected directory" << endl;
+            ::exit(1);
         }
-        vector<string> scripts_to_execute;
+        vector<string> ids;
         ::dirent      *entry;
         while ((entry = readdir(directory)) != nullptr) {
-            if (entry->d_type == DT_REG) {
-                string fname = entry->d_name;
-                if (fname.find(spec) == 0) {
-                    scripts_to_execute.push_back(
-                        fname.substr(0, fname.find_last_of('.'))
-                    );
-                }
+            string fname = entry->d_name;
+            if (fname.size() > 4 && fname.compare(fname.size() - 4, 4, ".png") == 0) {
+                ids.push_back(fname.substr(0, fname.size() - 4));
             }
         }
         ::closedir(directory);
+        sort(ids.begin(), ids.end());
+
+        ofstream out(manifest_file());
+        manifest.clear();
+        for (const string &id : ids) {
+            manifest[id] = image_hash(PNGImage(root_path + "/expected/" + id + ".png"));
+            out << hex << setw(16) << setfill('0') << manifest[id] << ' ' << id << '\n';
+        }
+        cout << "Wrote " << ids.size() << " hashes to " << manifest_file() << endl;
+    }
+
+    void run_tests(const string &spec, unsigned jobs) {
+        vector<string> scripts_to_execute;
+        if (!input_ids(spec, scripts_to_execute)) { return; }
+        for (const auto &test : unit_tests()) {
+            if (test.first.find(spec) == 0) { scripts_to_execute.push_back(test.first); }
+        }
         if (scripts_to_execute.empty()) {
             cout << "No scripts matched the spec: " << spec << endl;
             return;
         }
-        sort(scripts_to_execute.begin(), scripts_to_execute.end());
 
         cout << "== " << scripts_to_execute.size()
              << " tests to execute  ==" << endl;
-        for (string id : scripts_to_execute) { run_test(id); }
+        run_all(scripts_to_execute, jobs);
 
         cout << "== TEST EXECUTION SUMMARY ==" << endl
              << "Total tests: " << total_tests << endl
@@ -147,11 +712,43 @@ class TestDriver {
 } // namespace svg
 
 int main(int argc, char **argv) {
+    // Options come first, in any order: -j N runs up to N tests at once (0 uses one per hardware
+    // thread), and --write-manifest hashes the expected images before running the tests
+    const char *usage          = "Usage: test [--write-manifest] [-j N] [spec [root_path]]";
+    unsigned    jobs           = 1;
+    bool        write_manifest = false;
     --argc;
     ++argv;
+    while (argc >= 1 && argv[0][0] == '-') {
+        string option = argv[0];
+        int    used   = 1;
+        if (option == "--write-manifest") {
+            write_manifest = true;
+        } else if (option.compare(0, 2, "-j") == 0) {
+            used              = argv[0][2] ? 1 : 2; // -jN or -j N
+            const char *value = used == 1 ? argv[0] + 2 : argc >= 2 ? argv[1] : "";
+            char       *end;
+            long        n = strtol(value, &end, 10);
+            if (!*value || *end || n < 0) {
+                cerr << "Invalid number of jobs: " << value << endl << usage << endl;
+                return 1;
+            }
+            jobs = n ? (unsigned)n : max(1u, thread::hardware_concurrency());
+        } else {
+            cerr << "Unknown option " << option << endl << usage << endl;
+            return 1;
+        }
+        argc -= used;
+        argv += used;
+    }
+    if (argc > 2) {
+        cerr << usage << endl;
+        return 1;
+    }
     svg::TestDriver driver(argc == 2 ? argv[1] : ".");
     string          spec = argc >= 1 ? argv[0] : "";
-    driver.run_tests(spec);
+    if (write_manifest) driver.write_manifest();
+    driver.run_tests(spec, jobs);
 
     return 0;
 }